@@ -7,4 +7,10 @@ echo "Build start time: `date`"
 qmake osmscout-server_console.pro
 make
 
+mkdir -p build-tests
+cd build-tests
+qmake ../tests/tests.pro
+make check
+cd ..
+
 echo "Build end time: `date`"
@@ -0,0 +1,76 @@
+# Headless tile rendering benchmark
+#
+# Replays a list of tiles through the same rendering code as used by
+# the server. See README for usage and scripts/benchmark for generating
+# a small synthetic dataset.
+
+TARGET = osmscout-server-benchmark
+
+QT = core sql
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+CONFIG += use_map_qt
+#CONFIG += use_map_cairo
+
+# defines
+DEFINES += APP_VERSION=\\\"$$VERSION\\\"
+DEFINES += IS_CONSOLE_QT
+
+SOURCES += src/benchmark.cpp \
+    src/dbmaster.cpp \
+    src/appsettings.cpp \
+    src/dbmaster_search.cpp \
+    src/dbmaster_map.cpp \
+    src/searchresults.cpp \
+    src/infohub.cpp \
+    src/consolelogger.cpp \
+    src/dbmaster_route.cpp \
+    src/routingforhuman.cpp \
+    src/geomaster.cpp \
+    src/config.cpp \
+    src/tilecache.cpp \
+    src/renderprofiler.cpp \
+    src/tracer.cpp \
+    src/metrics.cpp \
+    src/watchdog.cpp
+
+include(src/geocoder-nlp/geocoder-nlp.pri)
+
+HEADERS += \
+    src/dbmaster.h \
+    src/appsettings.h \
+    src/config.h \
+    src/searchresults.h \
+    src/infohub.h \
+    src/consolelogger.h \
+    src/routingforhuman.h \
+    src/geomaster.h \
+    src/tilecache.h \
+    src/renderprofiler.h \
+    src/tracer.h \
+    src/metrics.h \
+    src/watchdog.h
+
+use_map_qt {
+    DEFINES += USE_OSMSCOUT_MAP_QT
+    QT += gui
+    LIBS += -losmscout_map_qt
+}
+
+use_map_cairo {
+    DEFINES += USE_OSMSCOUT_MAP_CAIRO
+    LIBS += -losmscout_map_cairo
+    CONFIG += link_pkgconfig
+    PKGCONFIG += pango cairo
+}
+
+LIBS += -losmscout_map -losmscout -lmarisa -lsqlite3
+
+QMAKE_CXXFLAGS += -fopenmp
+LIBS += -fopenmp
+
+CONFIG(release, debug|release) {
+    DEFINES += QT_NO_WARNING_OUTPUT QT_NO_DEBUG_OUTPUT
+}
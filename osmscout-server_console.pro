@@ -34,6 +34,7 @@ DEFINES += IS_CONSOLE_QT
 
 SOURCES += src/dbmaster.cpp \
     src/main.cpp \
+    src/endpointqueue.cpp \
     src/requestmapper.cpp \
     src/appsettings.cpp \
     src/dbmaster_search.cpp \
@@ -48,7 +49,17 @@ SOURCES += src/dbmaster.cpp \
     src/config.cpp \
     src/mapmanager.cpp \
     src/filedownloader.cpp \
-    src/mapmanagerfeature.cpp
+    src/mapmanagerfeature.cpp \
+    src/tilecache.cpp \
+    src/tilediskcache.cpp \
+    src/tilestats.cpp \
+    src/renderprofiler.cpp \
+    src/tracer.cpp \
+    src/metrics.cpp \
+    src/accesslog.cpp \
+    src/watchdog.cpp \
+    src/localserver.cpp \
+    src/supervisor.cpp
 
 OTHER_FILES += \
     osmscout-server.desktop
@@ -58,6 +69,7 @@ include(src/geocoder-nlp/geocoder-nlp.pri)
 
 HEADERS += \
     src/dbmaster.h \
+    src/endpointqueue.h \
     src/requestmapper.h \
     src/appsettings.h \
     src/config.h \
@@ -68,7 +80,17 @@ HEADERS += \
     src/geomaster.h \
     src/mapmanager.h \
     src/filedownloader.h \
-    src/mapmanagerfeature.h
+    src/mapmanagerfeature.h \
+    src/tilecache.h \
+    src/tilediskcache.h \
+    src/tilestats.h \
+    src/renderprofiler.h \
+    src/tracer.h \
+    src/metrics.h \
+    src/accesslog.h \
+    src/watchdog.h \
+    src/localserver.h \
+    src/supervisor.h
 
 use_map_qt {
     DEFINES += USE_OSMSCOUT_MAP_QT
@@ -83,7 +105,7 @@ use_map_cairo {
     PKGCONFIG += pango cairo
 }
 
-LIBS += -losmscout_map -losmscout -lmarisa -lsqlite3
+LIBS += -losmscout_map -losmscout -lmarisa -lsqlite3 -lrt
 
 QMAKE_CXXFLAGS += -fopenmp
 LIBS += -fopenmp
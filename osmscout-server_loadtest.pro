@@ -0,0 +1,18 @@
+# HTTP load generator
+#
+# Drives mixed traffic against a running server or against a server
+# started by the tool on an offline dataset. See README for usage and
+# scripts/benchmark for generating a small synthetic dataset.
+
+TARGET = osmscout-server-loadtest
+
+QT = core network
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+SOURCES += src/loadtest.cpp
+
+CONFIG(release, debug|release) {
+    DEFINES += QT_NO_WARNING_OUTPUT QT_NO_DEBUG_OUTPUT
+}
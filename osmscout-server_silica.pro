@@ -44,6 +44,7 @@ DEFINES += IS_SAILFISH_OS
 SOURCES += \
     src/dbmaster.cpp \
     src/main.cpp \
+    src/endpointqueue.cpp \
     src/requestmapper.cpp \
     src/appsettings.cpp \
     src/dbmaster_route.cpp \
@@ -60,6 +61,15 @@ SOURCES += \
     src/mapmanager.cpp \
     src/filedownloader.cpp \
     src/mapmanagerfeature.cpp \
+    src/tilecache.cpp \
+    src/tilediskcache.cpp \
+    src/tilestats.cpp \
+    src/renderprofiler.cpp \
+    src/tracer.cpp \
+    src/metrics.cpp \
+    src/accesslog.cpp \
+    src/watchdog.cpp \
+    src/localserver.cpp \
     src/sqlite/sqlite-amalgamation-3160200/sqlite3.c
 
 OTHER_FILES += qml/osmscout-server.qml \
@@ -72,6 +82,7 @@ include(src/geocoder-nlp/geocoder-nlp.pri)
 
 HEADERS += \
     src/dbmaster.h \
+    src/endpointqueue.h \
     src/requestmapper.h \
     src/appsettings.h \
     src/config.h \
@@ -84,6 +95,15 @@ HEADERS += \
     src/mapmanager.h \
     src/filedownloader.h \
     src/mapmanagerfeature.h \
+    src/tilecache.h \
+    src/tilediskcache.h \
+    src/tilestats.h \
+    src/renderprofiler.h \
+    src/tracer.h \
+    src/metrics.h \
+    src/accesslog.h \
+    src/watchdog.h \
+    src/localserver.h \
     src/sqlite/sqlite-amalgamation-3160200/sqlite3.h \
     src/sqlite/sqlite-amalgamation-3160200/sqlite3ext.h
 
@@ -101,7 +121,7 @@ use_map_cairo {
     PKGCONFIG += pango cairo
 }
 
-LIBS += -losmscout_map -losmscout -lmarisa -ldl
+LIBS += -losmscout_map -losmscout -lmarisa -ldl -lrt
 
 SAILFISHAPP_ICONS = 86x86 108x108 128x128 256x256
 
@@ -0,0 +1,34 @@
+#!/bin/bash
+
+# Generates synthetic dataset for the rendering benchmark and imports
+# it using libosmscout importer.
+#
+# Usage: prepare_dataset.sh Import map.ost output_dir [blocks]
+#
+# Import - libosmscout importer executable
+# map.ost - libosmscout type definitions used by the server maps
+
+set -e
+
+if [ $# -lt 3 ] ; then
+	echo "Usage: $0 Import map.ost output_dir [blocks]"
+	exit 1
+fi
+
+OSMSCOUT_IMPORTER=$1
+OSMSCOUT_MAPSTYLE=$2
+OUTDIR=$3
+BLOCKS=${4:-40}
+
+SCRIPTDIR=$(cd "$(dirname "$0")" && pwd)
+
+rm -rf "$OUTDIR"
+mkdir -p "$OUTDIR/map"
+
+python "$SCRIPTDIR/synthetic_osm.py" "$OUTDIR/synthetic.osm" "$OUTDIR/tiles.txt" "$BLOCKS"
+
+"$OSMSCOUT_IMPORTER" --typefile "$OSMSCOUT_MAPSTYLE" --delete-temporary-files true --delete-debugging-files true --delete-analysis-files true --delete-report-files true --destinationDirectory "$OUTDIR/map" "$OUTDIR/synthetic.osm"
+
+echo
+echo "Dataset ready. Run benchmark with:"
+echo "  osmscout-server-benchmark $OUTDIR/map $OUTDIR/tiles.txt"
@@ -0,0 +1,130 @@
+#!/usr/bin/env python
+
+# Generates small synthetic OSM dataset and the list of tiles covering
+# it. The dataset is used to benchmark rendering without downloading
+# maps. It contains a grid of streets of different classes, blocks
+# of buildings, parks, a lake, a river and places.
+#
+# Usage: synthetic_osm.py output.osm tiles.txt [blocks]
+
+from __future__ import print_function
+import math, sys
+
+if len(sys.argv) < 3:
+    print("Usage: %s output.osm tiles.txt [blocks]" % sys.argv[0])
+    sys.exit(1)
+
+osm_fname = sys.argv[1]
+tiles_fname = sys.argv[2]
+blocks = int(sys.argv[3]) if len(sys.argv) > 3 else 40
+
+# south-west corner and size of a block in degrees
+lat0, lon0 = 59.40, 24.60
+block = 0.002
+
+nodes = []
+ways = []
+
+def node(lat, lon, tags={}):
+    nodes.append( (len(nodes)+1, lat, lon, tags) )
+    return len(nodes)
+
+def way(refs, tags):
+    ways.append( (len(ways)+1, refs, tags) )
+
+def rectangle(lat, lon, dlat, dlon, tags):
+    r = [ node(lat, lon), node(lat, lon+dlon), node(lat+dlat, lon+dlon), node(lat+dlat, lon) ]
+    way(r + [r[0]], tags)
+
+# street grid, nodes are shared at intersections
+grid = {}
+for i in range(blocks+1):
+    for j in range(blocks+1):
+        grid[(i,j)] = node(lat0 + i*block, lon0 + j*block)
+
+def street_class(k):
+    if k % 20 == 0: return "primary"
+    if k % 10 == 0: return "secondary"
+    if k % 5 == 0: return "tertiary"
+    return "residential"
+
+for i in range(blocks+1):
+    way([grid[(i,j)] for j in range(blocks+1)],
+        {"highway": street_class(i), "name": "Street %d" % i})
+for j in range(blocks+1):
+    way([grid[(i,j)] for i in range(blocks+1)],
+        {"highway": street_class(j), "name": "Avenue %d" % j})
+
+# buildings and parks inside blocks
+margin = block * 0.15
+for i in range(blocks):
+    for j in range(blocks):
+        lat = lat0 + i*block + margin
+        lon = lon0 + j*block + margin
+        size = block - 2*margin
+        if (i*7 + j*3) % 17 == 0:
+            rectangle(lat, lon, size, size, {"leisure": "park", "name": "Park %d-%d" % (i,j)})
+        else:
+            half = size / 2.0 - margin / 4.0
+            for di in range(2):
+                for dj in range(2):
+                    rectangle(lat + di*(half + margin/2.0), lon + dj*(half + margin/2.0),
+                              half, half, {"building": "yes"})
+
+# lake and river
+center_lat = lat0 + blocks*block/2.0
+center_lon = lon0 + blocks*block/2.0
+r = [ node(center_lat + 0.6*block*math.sin(a*math.pi/16.0),
+           center_lon + 1.2*block*math.cos(a*math.pi/16.0)) for a in range(32) ]
+way(r + [r[0]], {"natural": "water", "name": "Lake"})
+
+r = [ node(lat0 - block/2.0 + k*block/2.0, lon0 + block/3.0 + 0.3*block*math.sin(k/3.0))
+      for k in range(2*blocks+2) ]
+way(r, {"waterway": "river", "name": "River"})
+
+# places
+node(center_lat, center_lon, {"place": "city", "name": "Synthetic City"})
+for k in range(4):
+    node(lat0 + (k % 2 + 0.25)*blocks*block/2.0,
+         lon0 + (k // 2 + 0.25)*blocks*block/2.0,
+         {"place": "suburb", "name": "Suburb %d" % k})
+
+def esc(s):
+    return s.replace("&", "&amp;").replace("\"", "&quot;").replace("<", "&lt;")
+
+with open(osm_fname, "w") as f:
+    f.write('<?xml version="1.0" encoding="UTF-8"?>\n<osm version="0.6" generator="synthetic_osm.py">\n')
+    f.write('<bounds minlat="%f" minlon="%f" maxlat="%f" maxlon="%f"/>\n' %
+            (lat0 - block, lon0 - block, lat0 + (blocks+1)*block, lon0 + (blocks+1)*block))
+    for i, lat, lon, tags in nodes:
+        if tags:
+            f.write('<node id="%d" version="1" lat="%.7f" lon="%.7f">\n' % (i, lat, lon))
+            for k, v in tags.items():
+                f.write(' <tag k="%s" v="%s"/>\n' % (esc(k), esc(v)))
+            f.write('</node>\n')
+        else:
+            f.write('<node id="%d" version="1" lat="%.7f" lon="%.7f"/>\n' % (i, lat, lon))
+    for i, refs, tags in ways:
+        f.write('<way id="%d" version="1">\n' % i)
+        for r in refs:
+            f.write(' <nd ref="%d"/>\n' % r)
+        for k, v in tags.items():
+            f.write(' <tag k="%s" v="%s"/>\n' % (esc(k), esc(v)))
+        f.write('</way>\n')
+    f.write('</osm>\n')
+
+# tiles covering the dataset, written in the format of tile lists
+# used by the server and the benchmark: daylight shift scale z x y
+def tile(lat, lon, z):
+    n = 2.0 ** z
+    x = int((lon + 180.0) / 360.0 * n)
+    y = int((1.0 - math.log(math.tan(math.radians(lat)) + 1.0/math.cos(math.radians(lat))) / math.pi) / 2.0 * n)
+    return x, y
+
+with open(tiles_fname, "w") as f:
+    for z in range(10, 18):
+        x0, y1 = tile(lat0, lon0, z)
+        x1, y0 = tile(lat0 + blocks*block, lon0 + blocks*block, z)
+        for x in range(x0, x1+1):
+            for y in range(y0, y1+1):
+                f.write("1 0 1 %d %d %d\n" % (z, x, y))
@@ -6,6 +6,7 @@ BNDSRC=`pwd`/backends-source
 BNDINSTALL=`pwd`/backends-install
 
 OSMSCOUT_IMPORTER=$BNDINSTALL/bin/Import
+OSMIUM=`pwd`/osmium/install/bin/osmium
 OSMSCOUT_MAPSTYLE=$BNDSRC/geocoder-nlp/importer/stylesheet/map.ost
 GEOCODER_IMPORTER=$BNDINSTALL/bin/geocoder-importer
 
@@ -22,18 +23,39 @@ CONTINENT_COUNTRY=$3
 COUNTRY_CODE=$4
 
 IMPDIR="$BASE_DIR/osmscout/$CONTINENT_COUNTRY"
+OVERVIEWDIR="$BASE_DIR/osmscout-overview/$CONTINENT_COUNTRY"
+OVERVIEWPBF="$OVERVIEWDIR.pbf"
 SQLDIR="$BASE_DIR/geocoder-nlp/$CONTINENT_COUNTRY"
 SQL="$SQLDIR/location.sqlite"
 
-rm -rf "$IMPDIR" "$SQLDIR"
+rm -rf "$IMPDIR" "$OVERVIEWDIR" "$OVERVIEWPBF" "$SQLDIR"
 mkdir -p "$IMPDIR"
+mkdir -p "$OVERVIEWDIR"
 mkdir -p "$SQLDIR"
 
 "$OSMSCOUT_IMPORTER" --typefile "$OSMSCOUT_MAPSTYLE" --delete-temporary-files true --delete-debugging-files true --delete-analysis-files true --delete-report-files true --destinationDirectory "$IMPDIR" "$PBF"
 
+# Overview dataset used for rendering low zoom levels. Only coastlines,
+# large water bodies, major boundaries, major roads and places are
+# kept. Generalized geometry for low zoom levels is generated by the
+# importer from the reduced data
+"$OSMIUM" tags-filter --overwrite -o "$OVERVIEWPBF" "$PBF" \
+          natural=coastline \
+          wr/natural=water wr/waterway=riverbank \
+          wr/admin_level=2,3,4 \
+          w/highway=motorway,motorway_link,trunk,trunk_link,primary,primary_link \
+          n/place=country,state,city,town
+
+"$OSMSCOUT_IMPORTER" --typefile "$OSMSCOUT_MAPSTYLE" --delete-temporary-files true --delete-debugging-files true --delete-analysis-files true --delete-report-files true --destinationDirectory "$OVERVIEWDIR" "$OVERVIEWPBF"
+
+# only files required for rendering are distributed
+(cd "$OVERVIEWDIR" && find . -type f ! \( -name 'area*' -o -name 'bounding.dat' -o -name 'nodes.dat' -o -name 'water.idx' -o -name 'ways*.dat' -o -name 'types.dat' \) -delete)
+rm -f "$OVERVIEWPBF"
+
 "$GEOCODER_IMPORTER" "$IMPDIR" "$SQL" "$COUNTRY_CODE"
 
 # determined from libosmscout/include/osmscout/TypeConfig.h:  static const uint32_t FILE_FORMAT_VERSION=11
 ./pack.sh "$IMPDIR" 11
+./pack.sh "$OVERVIEWDIR" 11
 
 ./pack.sh "$SQLDIR" 1
@@ -39,6 +39,7 @@ for root, folders, files in os.walk(Hierarchy.base_dir):
                                     "name": Hierarchy.get_full_name(root),
                                     "postal_country": { "path": "postal/countries/" + Hierarchy.get_postal(root) },
                                     "osmscout": { "path": "osmscout/" + spath(cid) },
+                                    "osmscout_overview": { "path": "osmscout-overview/" + spath(cid) },
                                     "geocoder_nlp": { "path": "geocoder-nlp/" + spath(cid) } }
         
         country_target = "$(BASE_DIR)/geocoder-nlp/" + spath(cid) + ".timestamp"
@@ -13,6 +13,7 @@ url_specs = {
     "base": url_base,
     "type": "url",
     "osmscout": "osmscout-2",
+    "osmscout_overview": "osmscout-overview-1",
     "geocoder_nlp": "geocoder-nlp-2",
     "postal_global": "postal-global-1",
     "postal_country": "postal-country-1",
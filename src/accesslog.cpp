@@ -0,0 +1,135 @@
+#include "accesslog.h"
+
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QMutexLocker>
+
+// buffered entries are written out at least this often, in milliseconds
+#define FLUSH_INTERVAL 1000
+
+namespace {
+
+struct State
+{
+    QMutex mutex;
+    QFile file;
+    qint64 max_size = 0;
+    QElapsedTimer last_flush;
+    std::atomic<bool> enabled{false};
+};
+
+State log_state;
+
+}
+
+bool AccessLog::setup(const QString &fname, qint64 max_size)
+{
+    QMutexLocker lk(&log_state.mutex);
+
+    log_state.enabled = false;
+    if (log_state.file.isOpen())
+        log_state.file.close();
+
+    if (fname.isEmpty())
+        return true;
+
+    log_state.file.setFileName(fname);
+    log_state.max_size = max_size;
+    if (!log_state.file.open(QIODevice::WriteOnly | QIODevice::Append))
+        return false;
+
+    log_state.last_flush.start();
+    log_state.enabled = true;
+    return true;
+}
+
+void AccessLog::close()
+{
+    QMutexLocker lk(&log_state.mutex);
+    log_state.enabled = false;
+    if (log_state.file.isOpen())
+        log_state.file.close();
+}
+
+std::shared_ptr<AccessLog::Entry> AccessLog::begin(const char *method, const QString &path,
+                                                   const QHash<QString, QString> &args,
+                                                   const QByteArray *body)
+{
+    if (!log_state.enabled)
+        return std::shared_ptr<Entry>();
+
+    std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+    entry->time = QDateTime::currentMSecsSinceEpoch();
+    entry->method = method;
+    entry->path = path;
+    entry->args = args;
+    if (body != nullptr)
+        entry->body = *body;
+    return entry;
+}
+
+void AccessLog::ready(const std::shared_ptr<Entry> &entry, qint64 nsecs)
+{
+    if (!entry)
+        return;
+    entry->latency = nsecs;
+    complete(entry);
+}
+
+void AccessLog::status(const std::shared_ptr<Entry> &entry, unsigned int status)
+{
+    if (!entry)
+        return;
+    entry->status = status;
+    complete(entry);
+}
+
+void AccessLog::complete(const std::shared_ptr<Entry> &entry)
+{
+    if (--entry->pending != 0)
+        return;
+
+    QJsonObject args;
+    for (auto i = entry->args.constBegin(); i != entry->args.constEnd(); ++i)
+        args.insert(i.key(), i.value());
+
+    QJsonObject o;
+    o.insert("time", (double)entry->time);
+    o.insert("method", QString::fromLatin1(entry->method));
+    o.insert("path", entry->path);
+    o.insert("args", args);
+    if (!entry->body.isEmpty())
+        o.insert("body", QString::fromUtf8(entry->body));
+    o.insert("status", (int)entry->status);
+    o.insert("latencyMs", entry->latency * 1e-6);
+
+    QByteArray line = QJsonDocument(o).toJson(QJsonDocument::Compact);
+    line.append('\n');
+
+    QMutexLocker lk(&log_state.mutex);
+    if (!log_state.enabled)
+        return;
+
+    log_state.file.write(line);
+
+    if (log_state.last_flush.elapsed() > FLUSH_INTERVAL)
+    {
+        log_state.file.flush();
+        log_state.last_flush.restart();
+    }
+
+    // rotate, keeping one previous log
+    if (log_state.max_size > 0 && log_state.file.size() > log_state.max_size)
+    {
+        QString fname = log_state.file.fileName();
+        log_state.file.close();
+        QFile::remove(fname + ".1");
+        QFile::rename(fname, fname + ".1");
+        if (!log_state.file.open(QIODevice::WriteOnly | QIODevice::Append))
+            log_state.enabled = false;
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef ACCESSLOG_H
+#define ACCESSLOG_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+
+#include <atomic>
+#include <memory>
+
+/// \brief Structured log of the served requests
+///
+/// Each request is written as a single line of JSON with the time of
+/// arrival, method, path, query arguments, body of POST requests, HTTP
+/// status and the time until the response was ready. The log can be
+/// replayed against the server by the load test tool. When the log
+/// exceeds its maximal size, it is rotated keeping one previous file.
+/// Thread safe.
+///
+/// Logging is disabled if the file name is empty.
+class AccessLog
+{
+public:
+    /// \brief Request being served
+    ///
+    /// Entry is written after both, the status and the readiness of the
+    /// response, are known. Depending on the request, either of them can
+    /// be the first
+    struct Entry
+    {
+        qint64 time = 0; ///< milliseconds since epoch
+        QByteArray method;
+        QString path;
+        QHash<QString, QString> args;
+        QByteArray body;
+
+        std::atomic<unsigned int> status{0};
+        std::atomic<qint64> latency{-1}; ///< nanoseconds
+        std::atomic<int> pending{2};
+    };
+
+public:
+    /// \brief Open the log, maximal size in bytes. Empty name disables logging
+    static bool setup(const QString &fname, qint64 max_size);
+
+    static void close();
+
+    /// \brief Start the entry of the request, returns nullptr if logging is disabled
+    static std::shared_ptr<Entry> begin(const char *method, const QString &path,
+                                        const QHash<QString, QString> &args,
+                                        const QByteArray *body);
+
+    /// \brief Response is ready after the given time from arrival
+    static void ready(const std::shared_ptr<Entry> &entry, qint64 nsecs);
+
+    /// \brief Response is sent with the given HTTP status
+    static void status(const std::shared_ptr<Entry> &entry, unsigned int status);
+
+protected:
+    static void complete(const std::shared_ptr<Entry> &entry);
+};
+
+#endif // ACCESSLOG_H
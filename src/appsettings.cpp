@@ -29,6 +29,65 @@ void AppSettings::initDefaults()
   CHECK("host", "127.0.0.1");
   CHECK("port", 8553);
   //CHECK("maxThreads", QThread::idealThreadCount() + 2);
+  CHECK("threads", 0); // network threads, 0 for one per CPU
+  CHECK("connectionLimit", 100);
+  CHECK("connectionTimeout", 600); // seconds
+  CHECK("compressionMinSize", 1024); // bytes, negative to disable compression
+  CHECK("socket", ""); // Unix domain socket path, disabled if empty
+  CHECK("socketPermissions", "0660"); // octal
+  CHECK("maxUploadSize", 1024*1024); // bytes, limits POST requests
+  CHECK("batchMaxOperations", 1000);
+  CHECK("reusePort", 0); // share the port with other processes using SO_REUSEPORT
+  CHECK("processes", 1); // number of worker processes, console version only
+  endGroup();
+
+  // number of the most recent spans kept for tracing, 0 to disable
+  beginGroup("tracing");
+  CHECK("spans", 0);
+  endGroup();
+
+  // log of the served requests in the cache directory, can be replayed by the load test tool
+  beginGroup("access-log");
+  CHECK("enable", 0);
+  CHECK("maxSize", 64); // in MB, the log is rotated when exceeded
+  endGroup();
+
+  // number of worker threads for each endpoint, 0 for one per CPU
+  beginGroup("workers");
+  CHECK("tile", 0);
+  CHECK("search", 0);
+  CHECK("guide", 0);
+  CHECK("route", 0);
+  endGroup();
+
+  // admission control: maximal number of running requests (0 for
+  // the number of worker threads) and requests waiting in the queue
+  beginGroup("admission");
+  CHECK("tileRunning", 0);
+  CHECK("tileQueue", 256);
+  CHECK("searchRunning", 0);
+  CHECK("searchQueue", 64);
+  CHECK("guideRunning", 0);
+  CHECK("guideQueue", 64);
+  CHECK("routeRunning", 0);
+  CHECK("routeQueue", 32);
+  CHECK("retryAfter", 5); // seconds
+  endGroup();
+
+  // requests waiting for the response longer than this are answered
+  // with timeout error, in seconds. 0 disables the deadline
+  beginGroup("deadlines");
+  CHECK("tile", 60);
+  CHECK("search", 60);
+  CHECK("guide", 60);
+  CHECK("route", 300);
+  endGroup();
+
+  // local transport for clients on the same device, disabled if socket is empty
+  beginGroup("local-listener");
+  CHECK("socket", "");
+  CHECK("slots", 16);
+  CHECK("slotSize", 256*1024);
   endGroup();
 
   CHECK(OSM_SETTINGS "units", 0);
@@ -46,6 +105,7 @@ void AppSettings::initDefaults()
   CHECK(MAPMANAGER_SETTINGS "geocoder_nlp", 0);
   CHECK(MAPMANAGER_SETTINGS "postal_country", 0);
   CHECK(MAPMANAGER_SETTINGS "max_download_speed_in_kbps", -1);
+  CHECK(MAPMANAGER_SETTINGS "manage_paths", 1); // when 0, database paths are not set by Map Manager
 
   // force URL setting
   QSettings::setValue(MAPMANAGER_SETTINGS "provided_url",
@@ -54,6 +114,7 @@ void AppSettings::initDefaults()
   /// used internally by MapManager to set the path - will be modified when support
   /// for multi-map handling is be ready
   CHECK(OSM_SETTINGS "map", "");
+  CHECK(OSM_SETTINGS "mapOverview", "");
 
   CHECK(OSM_SETTINGS "style", DATA_PREFIX "stylesheets/standard.oss");
   CHECK(OSM_SETTINGS "icons", DATA_PREFIX "data/icons/28x28/standard");
@@ -62,6 +123,13 @@ void AppSettings::initDefaults()
   CHECK(OSM_SETTINGS "drawBackground", 1);
   CHECK(OSM_SETTINGS "dataLookupArea", 1.25);
   CHECK(OSM_SETTINGS "tileBordersZoomCutoff", 16);
+  CHECK(OSM_SETTINGS "overviewZoomCutoff", 9);
+  CHECK(OSM_SETTINGS "renderProfile", 1); // 0 - off, 1 - collect phase timings, 2 - also libosmscout performance output
+  CHECK(OSM_SETTINGS "tileCacheSize", 16); // in MB
+  CHECK(OSM_SETTINGS "tileDiskCacheSize", 64); // in MB, 0 to disable
+  CHECK(OSM_SETTINGS "tileCacheWarmup", 64);
+  CHECK(OSM_SETTINGS "tileCacheServeStale", 1);
+  CHECK(OSM_SETTINGS "renderMetaTiles", 2); // number of tiles along metatile side
 
   CHECK(OSM_SETTINGS "rollingLoggerSize", 10);
   CHECK(OSM_SETTINGS "logInfo", 1);
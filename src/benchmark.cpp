@@ -0,0 +1,302 @@
+/// Headless tile rendering benchmark
+///
+/// Loads the map and replays a list of tiles through DBMaster::renderMap
+/// using the given number of threads. Tile list uses the same format as
+/// the list of frequently requested tiles saved by the server, one tile
+/// per line: "daylight shift scale z x y". Reports throughput, latency
+/// percentiles, timings of the rendering phases and peak memory usage.
+
+#include "appsettings.h"
+#include "config.h"
+#include "infohub.h"
+#include "consolelogger.h"
+#include "tilecache.h"
+#include "renderprofiler.h"
+
+#ifdef USE_OSMSCOUT_MAP_CAIRO
+#include <QCoreApplication>
+#endif
+#ifdef USE_OSMSCOUT_MAP_QT
+#include <QGuiApplication>
+#endif
+
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThreadPool>
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+extern InfoHub infoHub;
+
+static double tilex2long(int x, int z)
+{
+    return x / pow(2.0, z) * 360.0 - 180;
+}
+
+static double tiley2lat(int y, int z)
+{
+    double n = M_PI - 2.0 * M_PI * y / pow(2.0, z);
+    return 180.0 / M_PI * atan(0.5 * (exp(n) - exp(-n)));
+}
+
+/// \brief Renders tiles from the shared list until it is exhausted
+class Worker: public QRunnable
+{
+public:
+    Worker(const std::vector<TileCache::Key> &tiles, std::atomic<size_t> &next,
+           QMutex &mutex, std::vector<double> &latencies, std::atomic<size_t> &failed,
+           std::atomic<size_t> &bytes):
+        m_tiles(tiles), m_next(next), m_mutex(mutex), m_latencies(latencies),
+        m_failed(failed), m_bytes(bytes)
+    {
+    }
+
+    virtual void run()
+    {
+        std::vector<double> latencies;
+        QElapsedTimer timer;
+
+        for (size_t i = m_next++; i < m_tiles.size(); i = m_next++)
+        {
+            const TileCache::Key &key = m_tiles[i];
+            int ntiles = 1 << key.shift;
+            QByteArray result;
+
+            timer.start();
+            bool ok = osmScoutMaster->renderMap(key.daylight, 96*key.scale/ntiles, key.z + key.shift,
+                                                256*key.scale, 256*key.scale,
+                                                (tiley2lat(key.y, key.z) + tiley2lat(key.y+1, key.z))/2.0,
+                                                (tilex2long(key.x, key.z) + tilex2long(key.x+1, key.z))/2.0,
+                                                result);
+            double ms = timer.nsecsElapsed() * 1e-6;
+
+            if (ok)
+            {
+                latencies.push_back(ms);
+                m_bytes += result.size();
+            }
+            else
+                m_failed++;
+        }
+
+        QMutexLocker lk(&m_mutex);
+        m_latencies.insert(m_latencies.end(), latencies.begin(), latencies.end());
+    }
+
+protected:
+    const std::vector<TileCache::Key> &m_tiles;
+    std::atomic<size_t> &m_next;
+    QMutex &m_mutex;
+    std::vector<double> &m_latencies;
+    std::atomic<size_t> &m_failed;
+    std::atomic<size_t> &m_bytes;
+};
+
+static double percentile(const std::vector<double> &sorted, double p)
+{
+    // nearest-rank method
+    if (sorted.empty())
+        return 0;
+    size_t rank = (size_t)ceil(p/100.0 * sorted.size());
+    if (rank > 0) rank--;
+    return sorted[std::min(rank, sorted.size()-1)];
+}
+
+int main(int argc, char *argv[])
+{
+#ifdef USE_OSMSCOUT_MAP_CAIRO
+    QScopedPointer<QCoreApplication> app(new QCoreApplication(argc,argv));
+#endif
+#ifdef USE_OSMSCOUT_MAP_QT
+    QScopedPointer<QGuiApplication> app(new QGuiApplication(argc,argv));
+#endif
+
+    // separate settings from the server
+    app->setApplicationName("osmscout-server-benchmark");
+    app->setOrganizationName("osmscout-server");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Tile rendering benchmark for OSM Scout Server");
+    parser.addHelpOption();
+    parser.addPositionalArgument("map", "Directory with libosmscout map");
+    parser.addPositionalArgument("tiles", "File with the list of tiles: daylight shift scale z x y");
+
+    QCommandLineOption optOverview("overview", "Directory with overview map", "dir");
+    QCommandLineOption optStyle("style", "Map style", "file");
+    QCommandLineOption optIcons("icons", "Directory with icons", "dir");
+    QCommandLineOption optThreads("threads", "Number of rendering threads", "n", "1");
+    QCommandLineOption optRepeat("repeat", "Number of times the list is replayed", "n", "1");
+    QCommandLineOption optWarmup("warmup", "Number of tiles rendered before measurements", "n", "0");
+    QCommandLineOption optJson("json", "Write results as JSON into file, '-' for standard output", "file");
+    QCommandLineOption optVerbose("verbose", "Print server log messages");
+    parser.addOptions({optOverview, optStyle, optIcons, optThreads, optRepeat,
+                       optWarmup, optJson, optVerbose});
+
+    parser.process(*app);
+
+    const QStringList positional = parser.positionalArguments();
+    if (positional.size() != 2)
+    {
+        parser.showHelp(-1);
+    }
+
+    int threads = std::max(1, parser.value(optThreads).toInt());
+    int repeat = std::max(1, parser.value(optRepeat).toInt());
+    int warmup = std::max(0, parser.value(optWarmup).toInt());
+
+    // load tile list
+    std::vector<TileCache::Key> list;
+    for (const TileCache::Key &k: TileCache::loadHotKeys(positional[1]))
+        list.push_back(k);
+
+    if (list.empty())
+    {
+        std::cerr << "No tiles found in " << positional[1].toStdString() << std::endl;
+        return -1;
+    }
+
+    std::vector<TileCache::Key> tiles;
+    for (int r=0; r < repeat; ++r)
+        tiles.insert(tiles.end(), list.begin(), list.end());
+
+    // settings used by DBMaster
+    AppSettings settings;
+    settings.initDefaults();
+    settings.setValue(OSM_SETTINGS "map", positional[0]);
+    settings.setValue(OSM_SETTINGS "mapOverview", parser.value(optOverview));
+    settings.setValue(OSM_SETTINGS "renderProfile", 1);
+    settings.setValue(OSM_SETTINGS "logInfo", parser.isSet(optVerbose) ? 1 : 0);
+    if (parser.isSet(optStyle))
+        settings.setValue(OSM_SETTINGS "style", parser.value(optStyle));
+    if (parser.isSet(optIcons))
+        settings.setValue(OSM_SETTINGS "icons", parser.value(optIcons));
+
+    infoHub.onSettingsChanged();
+
+    QScopedPointer<ConsoleLogger> logger;
+    if (parser.isSet(optVerbose))
+        logger.reset(new ConsoleLogger());
+
+    osmScoutMaster = new DBMaster();
+    if (osmScoutMaster == nullptr || !(*osmScoutMaster))
+    {
+        std::cerr << "Failed to allocate DBMaster" << std::endl;
+        return -2;
+    }
+
+    // warmup, not included into results
+    {
+        QByteArray result;
+        for (int i=0; i < warmup; ++i)
+        {
+            const TileCache::Key &key = list[i % list.size()];
+            int ntiles = 1 << key.shift;
+            osmScoutMaster->renderMap(key.daylight, 96*key.scale/ntiles, key.z + key.shift,
+                                      256*key.scale, 256*key.scale,
+                                      (tiley2lat(key.y, key.z) + tiley2lat(key.y+1, key.z))/2.0,
+                                      (tilex2long(key.x, key.z) + tilex2long(key.x+1, key.z))/2.0,
+                                      result);
+        }
+    }
+
+    osmScoutMaster->renderProfiler().reset();
+
+    // replay
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> failed{0};
+    std::atomic<size_t> bytes{0};
+    QMutex mutex;
+    std::vector<double> latencies;
+
+    QElapsedTimer wall;
+    wall.start();
+
+    for (int t=0; t < threads; ++t)
+        pool.start(new Worker(tiles, next, mutex, latencies, failed, bytes));
+    pool.waitForDone();
+
+    double seconds = wall.nsecsElapsed() * 1e-9;
+
+    std::sort(latencies.begin(), latencies.end());
+
+    double mean = 0;
+    for (double l: latencies) mean += l;
+    if (!latencies.empty()) mean /= latencies.size();
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    long peak_rss_kb = usage.ru_maxrss;
+
+    // report
+    QJsonObject root;
+    root.insert("map", positional[0]);
+    root.insert("tileList", positional[1]);
+    root.insert("threads", threads);
+    root.insert("repeat", repeat);
+    root.insert("tiles", (double)latencies.size());
+    root.insert("failed", (double)failed.load());
+    root.insert("seconds", seconds);
+    root.insert("tilesPerSecond", seconds > 0 ? latencies.size() / seconds : 0.0);
+    root.insert("meanBytes", latencies.empty() ? 0.0 : (double)bytes.load() / latencies.size());
+    root.insert("peakRssKb", (double)peak_rss_kb);
+
+    QJsonObject lat;
+    lat.insert("mean", mean);
+    lat.insert("p50", percentile(latencies, 50));
+    lat.insert("p95", percentile(latencies, 95));
+    lat.insert("p99", percentile(latencies, 99));
+    lat.insert("max", latencies.empty() ? 0.0 : latencies.back());
+    root.insert("latencyMs", lat);
+
+    root.insert("render", QJsonDocument::fromJson(osmScoutMaster->renderProfiler().toJson()).object());
+
+    std::cout << "Tiles rendered: " << latencies.size() << " failed: " << failed.load()
+              << " threads: " << threads << "\n"
+              << "Throughput: " << (seconds > 0 ? latencies.size() / seconds : 0.0) << " tiles/s\n"
+              << "Latency, ms: mean " << mean
+              << " p50 " << percentile(latencies, 50)
+              << " p95 " << percentile(latencies, 95)
+              << " p99 " << percentile(latencies, 99) << "\n"
+              << "Peak RSS: " << peak_rss_kb << " kB\n"
+              << "Rendering phases, mean per tile:\n"
+              << osmScoutMaster->renderProfiler().summary().toStdString()
+              << std::flush;
+
+    if (parser.isSet(optJson))
+    {
+        QByteArray json = QJsonDocument(root).toJson();
+        QString fname = parser.value(optJson);
+        if (fname == "-")
+            std::cout << json.toStdString() << std::flush;
+        else
+        {
+            QFile file(fname);
+            if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) ||
+                    file.write(json) != json.size())
+            {
+                std::cerr << "Failed to write results: " << fname.toStdString() << std::endl;
+                return -3;
+            }
+        }
+    }
+
+    delete osmScoutMaster;
+    osmScoutMaster = nullptr;
+
+    return failed.load() > 0 ? 1 : 0;
+}
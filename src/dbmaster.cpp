@@ -2,16 +2,27 @@
 #include "appsettings.h"
 #include "config.h"
 #include "infohub.h"
+#include "metrics.h"
 
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QFileInfo>
 #include <QMutexLocker>
 #include <QDebug>
 
-DBMaster::DBMaster()
+// maximal number of ground tile coordinates kept in cache
+#define GROUND_TILES_CACHE_SIZE (256*1024)
+
+DBMaster::DBMaster():
+  m_ground_tiles_cache(GROUND_TILES_CACHE_SIZE)
 {
   m_database = osmscout::DatabaseRef(new osmscout::Database(m_database_parameter));
   m_map_service = osmscout::MapServiceRef(new osmscout::MapService(m_database));
 
-  if (m_database == nullptr)
+  m_overview_database = osmscout::DatabaseRef(new osmscout::Database(m_database_parameter));
+  m_overview_map_service = osmscout::MapServiceRef(new osmscout::MapService(m_overview_database));
+
+  if (m_database == nullptr || m_overview_database == nullptr)
     {
       InfoHub::logError(tr("Cannot create database object"));
       InfoHub::setError(true);
@@ -33,9 +44,14 @@ void DBMaster::loadSettings()
   QMutexLocker lk(&m_mutex);
   AppSettings settings;
 
+  bool render_changed = false;
+
   m_map_dir = settings.valueString(OSM_SETTINGS "map").toStdString();
   if ( !m_database->IsOpen() || m_map_dir != m_database->GetPath() )
     {
+      render_changed = true;
+      m_style_name_loaded.clear(); // style depends on database types
+
       if ( m_database->IsOpen() )
         m_database->Close();
 
@@ -44,31 +60,71 @@ void DBMaster::loadSettings()
 
           if (!m_database->Open(m_map_dir))
             {
+              Metrics::increment(Metrics::DatabaseOpenErrors);
               InfoHub::logError(tr("Cannot open database") + ": " + QString::fromStdString(m_map_dir));
+              m_render_generation++;
+              updateRenderIdentity();
+              m_ground_tiles_cache.clear();
               return;
             }
 
           // clear error state
+          Metrics::increment(Metrics::DatabaseOpens);
           InfoHub::logInfo(tr("Opened database") + " " + QString::fromStdString(m_map_dir), true);
         }
     }
 
-  m_icons_dir = settings.valueString(OSM_SETTINGS "icons").toStdString();
-  m_render_sea = ( settings.valueInt(OSM_SETTINGS "renderSea") > 0 );
-  m_draw_background = ( settings.valueInt(OSM_SETTINGS "drawBackground") > 0 );
-  m_font_size = settings.valueFloat(OSM_SETTINGS "fontSize");
-  m_data_lookup_area = std::max(1.0, settings.valueFloat(OSM_SETTINGS "dataLookupArea"));
-  m_tile_borders_zoom_cutoff = settings.valueFloat(OSM_SETTINGS "tileBordersZoomCutoff");
+  std::string overview_dir = settings.valueString(OSM_SETTINGS "mapOverview").toStdString();
+  if ( overview_dir != m_overview_dir )
+    {
+      render_changed = true;
+      m_style_name_loaded.clear();
+      loadOverview(overview_dir);
+    }
+
+  std::string icons_dir = settings.valueString(OSM_SETTINGS "icons").toStdString();
+  bool render_sea = ( settings.valueInt(OSM_SETTINGS "renderSea") > 0 );
+  bool draw_background = ( settings.valueInt(OSM_SETTINGS "drawBackground") > 0 );
+  float font_size = settings.valueFloat(OSM_SETTINGS "fontSize");
+  float data_lookup_area = std::max(1.0, settings.valueFloat(OSM_SETTINGS "dataLookupArea"));
+  int tile_borders_zoom_cutoff = settings.valueFloat(OSM_SETTINGS "tileBordersZoomCutoff");
+  int overview_zoom_cutoff = settings.valueInt(OSM_SETTINGS "overviewZoomCutoff");
+
+  if ( icons_dir != m_icons_dir ||
+       render_sea != m_render_sea ||
+       draw_background != m_draw_background ||
+       font_size != m_font_size ||
+       data_lookup_area != m_data_lookup_area ||
+       tile_borders_zoom_cutoff != m_tile_borders_zoom_cutoff ||
+       overview_zoom_cutoff != m_overview_zoom_cutoff )
+    render_changed = true;
+
+  m_icons_dir = icons_dir;
+  m_render_sea = render_sea;
+  m_draw_background = draw_background;
+  m_font_size = font_size;
+  m_data_lookup_area = data_lookup_area;
+  m_tile_borders_zoom_cutoff = tile_borders_zoom_cutoff;
+  m_overview_zoom_cutoff = overview_zoom_cutoff;
   m_routing_cost_distance = settings.valueFloat(OSM_SETTINGS "routingCostLimitDistance");
   m_routing_cost_factor = settings.valueFloat(OSM_SETTINGS "routingCostLimitFactor");
+  m_render_profile = settings.valueInt(OSM_SETTINGS "renderProfile");
 
   std::string style = settings.valueString(OSM_SETTINGS "style").toStdString();
-  if (m_style_name != style)
+  if (m_style_name != style || m_style_name_loaded.empty())
     {
+      render_changed = true;
       m_style_name = style;
       loadStyle(m_daylight);
     }
 
+  if (render_changed)
+    {
+      m_render_generation++;
+      updateRenderIdentity();
+      m_ground_tiles_cache.clear();
+    }
+
   // load speed table
   m_routing_speeds.clear();
   QStringList keys = settings.allKeys().filter(ROUTING_SPEED_SETTINGS);
@@ -80,6 +136,64 @@ void DBMaster::loadSettings()
     }
 }
 
+void DBMaster::updateRenderIdentity()
+{
+  // should be called with the mutex locked
+  auto stamp = [](const std::string &path) {
+    QFileInfo info(QString::fromStdString(path));
+    return QString::fromStdString(path) + ":" +
+        ( info.exists() ?
+            QString::number(info.lastModified().toMSecsSinceEpoch()) + ":" + QString::number(info.size()) :
+            QString("-") );
+  };
+
+  // daylight is not included, it is a part of the tile key and changes
+  // with the requests
+  QStringList parts;
+  parts << stamp(m_map_dir + "/types.dat")
+        << stamp(m_overview_dir + "/types.dat")
+        << stamp(m_style_name)
+        << QString::fromStdString(m_icons_dir)
+        << QString::number(m_render_sea)
+        << QString::number(m_draw_background)
+        << QString::number(m_font_size)
+        << QString::number(m_data_lookup_area)
+        << QString::number(m_tile_borders_zoom_cutoff)
+        << QString::number(m_overview_zoom_cutoff);
+
+  QByteArray hash = QCryptographicHash::hash(parts.join("\n").toUtf8(), QCryptographicHash::Sha1);
+
+  QMutexLocker lk(&m_render_identity_mutex);
+  m_render_identity = QString::fromLatin1(hash.toHex().left(16));
+}
+
+QString DBMaster::renderIdentity() const
+{
+  QMutexLocker lk(&m_render_identity_mutex);
+  return m_render_identity;
+}
+
+
+void DBMaster::loadOverview(const std::string &overview_dir)
+{
+  // should be called with the mutex locked
+  m_overview_dir = overview_dir;
+  m_overview_style_config.reset();
+
+  if ( m_overview_database->IsOpen() )
+    m_overview_database->Close();
+
+  if (m_overview_dir.empty())
+    return;
+
+  if (!m_overview_database->Open(m_overview_dir))
+    {
+      InfoHub::logWarning(tr("Cannot open overview database") + ": " + QString::fromStdString(m_overview_dir));
+      return;
+    }
+
+  InfoHub::logInfo(tr("Opened overview database") + " " + QString::fromStdString(m_overview_dir));
+}
 
 void DBMaster::onSettingsChanged()
 {
@@ -99,30 +213,45 @@ bool DBMaster::loadStyle(bool daylight)
     return true; // nothing to do, all is loaded
 
   // something changed, have to reload style
-  osmscout::TypeConfigRef typeConfig=m_database->GetTypeConfig();
-  if (!typeConfig) return false;
+  m_style_config = loadStyleConfig(m_database, daylight);
+  if (!m_style_config)
+    return false;
+
+  // overview is loaded with the same style. Since types are specific
+  // for each database, a separate style config is needed
+  m_overview_style_config.reset();
+  if ( m_overview_database->IsOpen() )
+    m_overview_style_config = loadStyleConfig(m_overview_database, daylight);
 
-  m_style_config = osmscout::StyleConfigRef(new osmscout::StyleConfig(typeConfig));
+  m_daylight = daylight;
+  m_style_name_loaded = m_style_name;
+  InfoHub::logInfo(tr("Loaded style") + ": " + QString::fromStdString(m_style_name));
 
-  if (m_style_config == nullptr)
+  return true;
+}
+
+osmscout::StyleConfigRef DBMaster::loadStyleConfig(osmscout::DatabaseRef database, bool daylight)
+{
+  osmscout::TypeConfigRef typeConfig=database->GetTypeConfig();
+  if (!typeConfig) return osmscout::StyleConfigRef();
+
+  osmscout::StyleConfigRef style_config(new osmscout::StyleConfig(typeConfig));
+
+  if (style_config == nullptr)
     {
       InfoHub::logError(tr("Cannot allocate Style config"));
-      return false;
+      return osmscout::StyleConfigRef();
     }
 
-  m_style_config->AddFlag("daylight", daylight);
+  style_config->AddFlag("daylight", daylight);
 
-  if (!m_style_config->Load(m_style_name))
+  if (!style_config->Load(m_style_name))
     {
       InfoHub::logError(tr("Cannot open style") + ": " + QString::fromStdString(m_style_name));
-      return false;
+      return osmscout::StyleConfigRef();
     }
 
-  m_daylight = daylight;
-  m_style_name_loaded = m_style_name;
-  InfoHub::logInfo(tr("Loaded style") + ": " + QString::fromStdString(m_style_name));
-
-  return true;
+  return style_config;
 }
 
 void DBMaster::onDatabaseChanged(QString /*directory*/)
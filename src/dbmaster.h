@@ -5,8 +5,10 @@
 #include <osmscout/MapService.h>
 
 #include "searchresults.h"
+#include "renderprofiler.h"
 
 #include <QMutex>
+#include <QCache>
 #include <QByteArray>
 #include <QObject>
 #include <QVector>
@@ -14,8 +16,11 @@
 #include <QString>
 #include <QStringList>
 
+#include <functional>
 #include <string>
 #include <map>
+#include <atomic>
+#include <vector>
 
 /// \brief Access to all OSM Scout functionality
 ///
@@ -30,6 +35,14 @@ public:
 
     bool renderMap(bool daylight, double dpi, int zoom_level, int width, int height, double lat, double lon, QByteArray &result);
 
+    /// \brief Render map and split it into split x split images of equal size
+    ///
+    /// Used to render several tiles at once with the labels placed
+    /// consistently across tile borders. Images are returned in
+    /// row-major order, as PNG
+    bool renderMap(bool daylight, double dpi, int zoom_level, int width, int height, double lat, double lon,
+                   int split, std::vector<QByteArray> &results);
+
     // Has to have a different name allowing to bind it
     bool searchExposed(const QString &searchPattern, QByteArray &result, size_t limit);
 
@@ -50,13 +63,40 @@ public:
 
     bool poiTypes(QByteArray &result); ///< Fill results with list of supported POI types
 
+    /// Receives chunks of the output while it is produced, returns false to abort
+    typedef std::function<bool(const QByteArray &chunk)> OutputSink;
+
+    /// \brief Calculate route and return it in JSON or GPX format
+    ///
+    /// If sink is given, the result is submitted in chunks while it is
+    /// serialized, with the last chunk left in result. Serialization is
+    /// done after releasing the database lock
     bool route(osmscout::Vehicle &vehicle, std::vector< osmscout::GeoCoord > &coordinates, double radius,
-               const std::vector< std::string > &names, bool gpx, QByteArray &result);
+               const std::vector< std::string > &names, bool gpx, QByteArray &result,
+               const OutputSink &sink = OutputSink());
 
     /// \brief checks if DBMaster object is ready for operation
     ///
     operator bool() const { return !m_error_flag; }
 
+    /// \brief Generation of the rendering settings
+    ///
+    /// Increased every time when the database, style or other settings
+    /// influencing the rendered tiles are changed. Used to invalidate
+    /// cached tiles
+    int renderGeneration() const { return m_render_generation; }
+
+    /// \brief Identity of the rendering settings
+    ///
+    /// Hash of the databases, style and other settings influencing the
+    /// rendered tiles. In contrast to the generation, it is the same in
+    /// all processes using the same settings and is kept between the
+    /// sessions unless the map or style files are updated
+    QString renderIdentity() const;
+
+    /// \brief Timings of the rendering phases, per zoom level
+    RenderProfiler& renderProfiler() { return m_render_profiler; }
+
     void loadSettings();
 
 public slots:
@@ -66,6 +106,22 @@ public slots:
 protected:
 
     bool loadStyle(bool daylight);
+    osmscout::StyleConfigRef loadStyleConfig(osmscout::DatabaseRef database, bool daylight);
+
+    void loadOverview(const std::string &overview_dir);
+
+    /// \brief Calculate the identity of the rendering settings
+    ///
+    /// Should be called with the mutex locked
+    void updateRenderIdentity();
+
+    /// \brief Fill ground tiles covering the projection using cache
+    ///
+    /// Ground tiles are looked up for coarse cells covering the projection
+    /// and are cached. Should be called with the mutex locked
+    void getGroundTiles(osmscout::MapServiceRef map_service, bool overview,
+                        const osmscout::Projection &projection,
+                        std::list<osmscout::GroundTile> &tiles);
 
     bool search(const QString &search, SearchResults &result, size_t limit);
 
@@ -73,8 +129,12 @@ protected:
     QMutex m_mutex;
 
     bool m_error_flag=false;
+    std::atomic<int> m_render_generation{0};
+    mutable QMutex m_render_identity_mutex;
+    QString m_render_identity;
 
     std::string m_map_dir;
+    std::string m_overview_dir;
     std::string m_icons_dir;
     std::string m_style_name;
     std::string m_style_name_loaded;
@@ -84,6 +144,8 @@ protected:
     float m_font_size = 3.0;
     float m_data_lookup_area = 1.5;
     int m_tile_borders_zoom_cutoff = 20;
+    int m_overview_zoom_cutoff = 9;
+    int m_render_profile = 1;
     bool m_daylight = true;
 
     double m_routing_cost_distance = 50.0;
@@ -95,6 +157,17 @@ protected:
     osmscout::DatabaseRef m_database;
     osmscout::MapServiceRef m_map_service;
     osmscout::StyleConfigRef m_style_config;
+
+    // generalized dataset used to render low zoom levels
+    osmscout::DatabaseRef m_overview_database;
+    osmscout::MapServiceRef m_overview_map_service;
+    osmscout::StyleConfigRef m_overview_style_config;
+
+    // ground tiles cached per coarse cell. Key is composed from the
+    // dataset, magnification level and the cell indexes
+    QCache< quint64, std::list<osmscout::GroundTile> > m_ground_tiles_cache;
+
+    RenderProfiler m_render_profiler;
 };
 
 #endif // DBMASTER_H
@@ -2,8 +2,14 @@
 #include "appsettings.h"
 #include "config.h"
 #include "infohub.h"
+#include "tracer.h"
 
 #include <QMutexLocker>
+#include <QElapsedTimer>
+
+#include <algorithm>
+#include <cmath>
+#include <set>
 
 // check for sanity
 #ifdef USE_OSMSCOUT_MAP_QT
@@ -47,7 +53,84 @@ cairo_status_t cairo_write_to_buffer(void *closure,
 #endif // MAP CAIRO
 
 
+void DBMaster::getGroundTiles(osmscout::MapServiceRef map_service, bool overview,
+                              const osmscout::Projection &projection,
+                              std::list<osmscout::GroundTile> &tiles)
+{
+    // Ground tiles are cached for coarse cells with the size of the cell
+    // corresponding to 8x8 tiles at the current zoom level. Ground tiles
+    // of the cells covering the projection are merged with the duplicates,
+    // that are found when water index cell is covered by several coarse cells,
+    // dropped.
+    osmscout::Magnification magnification = projection.GetMagnification();
+    size_t level = magnification.GetLevel();
+    int coarse_level = std::max(0, (int)level - 3);
+    double cell_size = 360.0 / (1 << coarse_level);
+
+    osmscout::GeoBox box;
+    projection.GetDimensions(box);
+
+    int x0 = std::max(0, (int)floor((box.GetMinLon() + 180.0) / cell_size));
+    int x1 = std::min((1 << coarse_level) - 1, (int)floor((box.GetMaxLon() + 180.0) / cell_size));
+    int ny = std::max(1, (1 << coarse_level) / 2);
+    int y0 = std::max(0, (int)floor((box.GetMinLat() + 90.0) / cell_size));
+    int y1 = std::min(ny - 1, (int)floor((box.GetMaxLat() + 90.0) / cell_size));
+
+    std::set< std::pair<size_t, size_t> > added;
+    for (int x = x0; x <= x1; ++x)
+        for (int y = y0; y <= y1; ++y)
+        {
+            quint64 key = ( (quint64)(overview ? 1 : 0) << 63 ) |
+                    ( (quint64)level << 56 ) |
+                    ( (quint64)x << 28 ) | (quint64)y;
+
+            std::list<osmscout::GroundTile> uncached;
+            std::list<osmscout::GroundTile> *cell = m_ground_tiles_cache.object(key);
+            if (cell == nullptr)
+            {
+                osmscout::GeoBox cellbox(osmscout::GeoCoord(y*cell_size - 90.0, x*cell_size - 180.0),
+                                         osmscout::GeoCoord(std::min(90.0, (y+1)*cell_size - 90.0),
+                                                            (x+1)*cell_size - 180.0));
+                map_service->GetGroundTiles(cellbox, magnification, uncached);
+
+                int cost = 1;
+                for (const osmscout::GroundTile &t: uncached)
+                    cost += t.coords.size() + 1;
+
+                cell = &uncached;
+                if (cost <= m_ground_tiles_cache.maxCost())
+                {
+                    cell = new std::list<osmscout::GroundTile>(uncached);
+                    m_ground_tiles_cache.insert(key, cell, cost);
+                }
+            }
+
+            std::set< std::pair<size_t, size_t> > cell_added;
+            for (const osmscout::GroundTile &t: *cell)
+            {
+                std::pair<size_t, size_t> p(t.xAbs, t.yAbs);
+                if (added.count(p) > 0)
+                    continue;
+                cell_added.insert(p);
+                tiles.push_back(t);
+            }
+
+            added.insert(cell_added.begin(), cell_added.end());
+        }
+}
+
 bool DBMaster::renderMap(bool daylight, double dpi, int zoom_level, int width, int height, double lat, double lon, QByteArray &result)
+{
+    std::vector<QByteArray> results;
+    if ( !renderMap(daylight, dpi, zoom_level, width, height, lat, lon, 1, results) )
+        return false;
+
+    result = results[0];
+    return true;
+}
+
+bool DBMaster::renderMap(bool daylight, double dpi, int zoom_level, int width, int height, double lat, double lon,
+                         int split, std::vector<QByteArray> &results)
 {
 //    qDebug() << "Map rendering: day=" << daylight << " "
 //             << " dpi=" << dpi
@@ -57,15 +140,29 @@ bool DBMaster::renderMap(bool daylight, double dpi, int zoom_level, int width, i
 //             << " lat=" << lat
 //             << " lon=" << lon;
 
-    if (m_error_flag) return false;
+    if (m_error_flag || split < 1) return false;
+
+    // timings of the rendering phases
+    RenderProfiler::Sample sample;
+    QElapsedTimer total_timer;
+    QElapsedTimer timer;
+    total_timer.start();
+    timer.start();
 
     // initialize local variables with current settings
+    int profile;
     bool renderSea;
     bool drawBackground;
     float fontSize;
     std::list<std::string> paths;
+    osmscout::MapServiceRef map_service;
+    osmscout::StyleConfigRef style_config;
     {
+        Tracer::Span span("db wait");
         QMutexLocker lk(&m_mutex);
+        sample.nsecs[RenderProfiler::PhaseWait] += timer.nsecsElapsed();
+        timer.restart();
+        span.next("style");
 
         if (!m_database->IsOpen())
         {
@@ -73,6 +170,7 @@ bool DBMaster::renderMap(bool daylight, double dpi, int zoom_level, int width, i
             return false;
         }
 
+        profile = m_render_profile;
         renderSea = m_render_sea;
         drawBackground = m_draw_background;
         fontSize = m_font_size;
@@ -80,6 +178,21 @@ bool DBMaster::renderMap(bool daylight, double dpi, int zoom_level, int width, i
 
         if ( !loadStyle(daylight) )
             return false;
+
+        // use generalized overview dataset for low zoom levels, if available
+        if ( zoom_level <= m_overview_zoom_cutoff &&
+             m_overview_database->IsOpen() && m_overview_style_config )
+        {
+            map_service = m_overview_map_service;
+            style_config = m_overview_style_config;
+        }
+        else
+        {
+            map_service = m_map_service;
+            style_config = m_style_config;
+        }
+
+        sample.nsecs[RenderProfiler::PhaseStyle] = timer.nsecsElapsed();
     }
 
     osmscout::MercatorProjection  projection;
@@ -95,7 +208,7 @@ bool DBMaster::renderMap(bool daylight, double dpi, int zoom_level, int width, i
     //drawParameter.SetPatternPaths(paths);
 
     drawParameter.SetDebugData(false);
-    drawParameter.SetDebugPerformance(false);
+    drawParameter.SetDebugPerformance(profile > 1);
 
     drawParameter.SetFontSize(fontSize);
 
@@ -144,18 +257,34 @@ bool DBMaster::renderMap(bool daylight, double dpi, int zoom_level, int width, i
                    height * m_data_lookup_area);
 
     {
+        timer.restart();
+        Tracer::Span span("db wait");
         QMutexLocker lk(&m_mutex);
+        sample.nsecs[RenderProfiler::PhaseWait] += timer.nsecsElapsed();
+        span.next("load data");
 
         std::list<osmscout::TileRef> tiles;
 
-        m_map_service->LookupTiles(searchProjection,tiles);
-        m_map_service->LoadMissingTileData(searchParameter,*m_style_config,tiles);
-        m_map_service->AddTileDataToMapData(tiles,data);
-
+        timer.restart();
+        map_service->LookupTiles(searchProjection,tiles);
+        sample.nsecs[RenderProfiler::PhaseLookupTiles] = timer.nsecsElapsed();
+        timer.restart();
+        map_service->LoadMissingTileData(searchParameter,*style_config,tiles);
+        sample.nsecs[RenderProfiler::PhaseLoadData] = timer.nsecsElapsed();
+        timer.restart();
+        map_service->AddTileDataToMapData(tiles,data);
+        sample.nsecs[RenderProfiler::PhaseAddData] = timer.nsecsElapsed();
+
+        timer.restart();
         if (drawParameter.GetRenderSeaLand())
-            m_map_service->GetGroundTiles(searchProjection, data.groundTiles);
+            getGroundTiles(map_service, map_service == m_overview_map_service,
+                           searchProjection, data.groundTiles);
+        sample.nsecs[RenderProfiler::PhaseGroundTiles] = timer.nsecsElapsed();
     }
 
+    timer.restart();
+    Tracer::Span span("draw");
+
 #ifdef USE_OSMSCOUT_MAP_QT
     //    QPixmap *pixmap=new QPixmap(width,height);
     //    if (pixmap == NULL)
@@ -173,7 +302,7 @@ bool DBMaster::renderMap(bool daylight, double dpi, int zoom_level, int width, i
     painter->setRenderHint(QPainter::TextAntialiasing);
     painter->setRenderHint(QPainter::SmoothPixmapTransform);
 
-    osmscout::MapPainterQt mapPainter(m_style_config);
+    osmscout::MapPainterQt mapPainter(style_config);
 #endif
 
 #ifdef USE_OSMSCOUT_MAP_CAIRO
@@ -190,7 +319,7 @@ bool DBMaster::renderMap(bool daylight, double dpi, int zoom_level, int width, i
         return false;
     }
 
-    osmscout::MapPainterCairo mapPainter(m_style_config);
+    osmscout::MapPainterCairo mapPainter(style_config);
 #endif
 
     bool success = false;
@@ -207,27 +336,61 @@ bool DBMaster::renderMap(bool daylight, double dpi, int zoom_level, int width, i
                            )
             )
     {
-#ifdef USE_OSMSCOUT_MAP_QT
-        QBuffer buffer(&result);
-        buffer.open(QIODevice::WriteOnly);
-        image.save(&buffer, "PNG");
+        sample.nsecs[RenderProfiler::PhaseDraw] = timer.nsecsElapsed();
+        timer.restart();
+        span.next("encode");
+
+        // image is split into parts in row-major order
+        int part_width = width / split;
+        int part_height = height / split;
         success = true;
+        results.clear();
+        for (int j=0; j < split && success; ++j)
+            for (int i=0; i < split && success; ++i)
+            {
+                QByteArray result;
+
+#ifdef USE_OSMSCOUT_MAP_QT
+                QBuffer buffer(&result);
+                buffer.open(QIODevice::WriteOnly);
+                if (split == 1)
+                    image.save(&buffer, "PNG");
+                else
+                    image.copy(i*part_width, j*part_height, part_width, part_height).save(&buffer, "PNG");
 #endif
 
 #ifdef USE_OSMSCOUT_MAP_CAIRO
-        QDataStream datastream(&result, QIODevice::WriteOnly);
-        if ( cairo_surface_write_to_png_stream (surface,
-                                                cairo_write_to_buffer,
-                                                &datastream) == CAIRO_STATUS_SUCCESS )
-            success = true;
-        else
-        {
-            InfoHub::logError("Error while writing cairo stream");
-        }
+                cairo_surface_t *part = surface;
+                if (split > 1)
+                {
+                    part = cairo_image_surface_create(CAIRO_FORMAT_RGB24, part_width, part_height);
+                    cairo_t *c = cairo_create(part);
+                    cairo_set_source_surface(c, surface, -i*part_width, -j*part_height);
+                    cairo_paint(c);
+                    cairo_destroy(c);
+                }
+
+                QDataStream datastream(&result, QIODevice::WriteOnly);
+                if ( cairo_surface_write_to_png_stream (part,
+                                                        cairo_write_to_buffer,
+                                                        &datastream) != CAIRO_STATUS_SUCCESS )
+                {
+                    InfoHub::logError("Error while writing cairo stream");
+                    success = false;
+                }
+
+                if (part != surface)
+                    cairo_surface_destroy(part);
 #endif
 
+                results.push_back(result);
+            }
+
+        sample.nsecs[RenderProfiler::PhaseEncode] = timer.nsecsElapsed();
     }
 
+    span.end();
+
 #ifdef USE_OSMSCOUT_MAP_QT
     delete painter;
 #endif
@@ -236,5 +399,17 @@ bool DBMaster::renderMap(bool daylight, double dpi, int zoom_level, int width, i
     cairo_surface_destroy(surface);
 #endif
 
+    if (success && profile > 0)
+    {
+        sample.nsecs[RenderProfiler::PhaseTotal] = total_timer.nsecsElapsed();
+        sample.nodes = data.nodes.size();
+        sample.ways = data.ways.size() + data.poiWays.size();
+        sample.areas = data.areas.size() + data.poiAreas.size();
+        sample.ground_tiles = data.groundTiles.size();
+        for (const QByteArray &r: results)
+            sample.bytes += r.size();
+        m_render_profiler.record(zoom_level, sample);
+    }
+
     return success;
 }
@@ -3,6 +3,8 @@
 #include "config.h"
 #include "infohub.h"
 #include "routingforhuman.h"
+#include "tracer.h"
+#include "watchdog.h"
 
 #include <osmscout/RoutingService.h>
 #include <osmscout/RoutePostprocessor.h>
@@ -20,6 +22,85 @@
 
 #define H2S(x) ((x)*60.0*60.0) // hours -> seconds
 
+// size of the chunks submitted while streaming the route
+#define OUTPUT_CHUNK_SIZE (64*1024)
+
+// coordinates are serialized in batches of this size
+#define COORDINATES_BATCH 1024
+
+/// Collects the serialized route. If sink is given, output is submitted
+/// in chunks as it grows, keeping only the last chunk in the result
+class RouteOutput
+{
+public:
+    RouteOutput(QByteArray &result, const DBMaster::OutputSink &sink):
+        m_result(result),
+        m_sink(sink),
+        m_stream(&m_result, QIODevice::WriteOnly)
+    {
+        m_result.clear();
+        m_stream.setRealNumberPrecision(8);
+    }
+
+    QTextStream& stream() { return m_stream; }
+
+    void write(const QByteArray &data)
+    {
+        m_stream.flush();
+        m_stream.device()->write(data);
+    }
+
+    /// Returns false if the output was aborted by sink
+    bool flush()
+    {
+        m_stream.flush();
+        if (!m_sink || m_result.size() < OUTPUT_CHUNK_SIZE)
+            return true;
+
+        if (!m_sink(m_result))
+            return false;
+
+        m_result.clear();
+        m_stream.seek(0);
+        return true;
+    }
+
+protected:
+    QByteArray &m_result;
+    const DBMaster::OutputSink &m_sink;
+    QTextStream m_stream;
+};
+
+// writes coordinates as JSON array elements, without brackets
+static bool writeCoordinates(RouteOutput &output, const std::list<osmscout::Point> &points, bool latitude)
+{
+    QJsonArray batch;
+    bool first = true;
+
+    std::list<osmscout::Point>::const_iterator iter = points.begin();
+    while (iter != points.end() || !batch.isEmpty())
+    {
+        if (iter != points.end())
+        {
+            batch.append(latitude ? iter->GetLat() : iter->GetLon());
+            ++iter;
+            if (batch.size() < COORDINATES_BATCH && iter != points.end())
+                continue;
+        }
+
+        QByteArray a = QJsonDocument(batch).toJson(QJsonDocument::Compact);
+        if (!first) output.write(",");
+        output.write(a.mid(1, a.size()-2));
+        first = false;
+        batch = QJsonArray();
+
+        if (!output.flush())
+            return false;
+    }
+
+    return true;
+}
+
 
 static bool HasRelevantDescriptions(const osmscout::RouteDescription::Node& node)
 {
@@ -66,14 +147,17 @@ static bool HasRelevantDescriptions(const osmscout::RouteDescription::Node& node
 /////////////////////////////////////////////////////////////////////////////////////////
 /// Main routing function
 bool DBMaster::route(osmscout::Vehicle &vehicle, std::vector<osmscout::GeoCoord> &via, double radius,
-                     const std::vector< std::string > &names, bool gpx, QByteArray &result)
+                     const std::vector< std::string > &names, bool gpx, QByteArray &result,
+                     const OutputSink &sink)
 {
     ///////////////////////////////////////////////////////////
     /// Check if everything is OK and lock the mutex
     ///////////////////////////////////////////////////////////
     if (m_error_flag) return false;
 
+    Tracer::Span span("db wait");
     QMutexLocker lk(&m_mutex);
+    span.next("routing");
 
     if (!m_database->IsOpen())
     {
@@ -128,13 +212,21 @@ bool DBMaster::route(osmscout::Vehicle &vehicle, std::vector<osmscout::GeoCoord>
     routingProfile.SetCostLimitDistance(m_routing_cost_distance);
     routingProfile.SetCostLimitFactor(m_routing_cost_factor);
 
+    // calculation is aborted when the request times out
     osmscout::RoutingParameter parameter;
+    osmscout::BreakerRef breaker = Watchdog::current();
+    if (breaker)
+        parameter.SetBreaker(breaker);
+
     osmscout::RoutingResult routingResult = router->CalculateRoute(routingProfile,
                                                                    via, radius,
                                                                    parameter);
     if (!routingResult.Success())
     {
-        InfoHub::logWarning(tr("There was an error while calculating the route!"));
+        if (Watchdog::expired())
+            InfoHub::logInfo("Routing aborted, request timed out");
+        else
+            InfoHub::logWarning(tr("There was an error while calculating the route!"));
         router->Close();
         return false;
     }
@@ -154,8 +246,14 @@ bool DBMaster::route(osmscout::Vehicle &vehicle, std::vector<osmscout::GeoCoord>
         ////////////////////////////////////////////////////
         /// AS GPX
         ////////////////////////////////////////////////////
-        QTextStream output(&result, QIODevice::WriteOnly);
-        output.setRealNumberPrecision(8);
+
+        // database is not needed for serialization
+        router->Close();
+        lk.unlock();
+        span.next("output");
+
+        RouteOutput out(result, sink);
+        QTextStream &output = out.stream();
 
         output << "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"no\" ?>" << "\n";
         output << "<gpx xmlns=\"http://www.topografix.com/GPX/1/1\" creator=\"bin2gpx\" version=\"1.1\" xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\" xsi:schemaLocation=\"http://www.topografix.com/GPX/1/1 http://www.topografix.com/GPX/1/1/gpx.xsd\">" << "\n";
@@ -173,16 +271,20 @@ bool DBMaster::route(osmscout::Vehicle &vehicle, std::vector<osmscout::GeoCoord>
         output << "\t<trk>" << "\n";
         output << "\t\t<name>Route</name>" << "\n";
         output << "\t\t<trkseg>" << "\n";
+        size_t counter = 0;
         for (const auto &point : route_points)
         {
             output << "\t\t\t<trkpt lat=\""<< point.GetLat() << "\" lon=\""<< point.GetLon() <<"\">" << "\n";
             output << "\t\t\t\t<fix>2d</fix>" << "\n";
             output << "\t\t\t</trkpt>" << "\n";
+
+            if ( (++counter) % COORDINATES_BATCH == 0 && !out.flush() )
+                return false;
         }
         output << "\t\t</trkseg>" << "\n";
         output << "\t</trk>" << "\n";
         output << "</gpx>" << "\n";
-        router->Close();
+        output.flush();
         return true;
     }
 
@@ -257,19 +359,7 @@ bool DBMaster::route(osmscout::Vehicle &vehicle, std::vector<osmscout::GeoCoord>
         rootObj.insert("locations", locations);
     }
 
-    {   /// route in coordinates
-        QJsonArray lat;
-        QJsonArray lon;
-
-        for (const osmscout::Point &p : route_points)
-        {
-            lat.push_back(p.GetLat());
-            lon.push_back(p.GetLon());
-        }
-
-        rootObj.insert("lat", lat);
-        rootObj.insert("lng", lon);
-    }
+    // route in coordinates is serialized separately below
 
     ////////////////////////////////////////////////////////////////////////
     /// Route description in maneuvers
@@ -465,6 +555,8 @@ bool DBMaster::route(osmscout::Vehicle &vehicle, std::vector<osmscout::GeoCoord>
     //////////////////////////////////////////////////////////////////////////////////////////////
     /// DONE
     router->Close();
+    lk.unlock();
+    span.next("output");
 
     //////////////////////////////////////////////////////////////////////////////////////////////
     /// SAVE RESULTS
@@ -476,8 +568,18 @@ bool DBMaster::route(osmscout::Vehicle &vehicle, std::vector<osmscout::GeoCoord>
     summary.insert("length", totalDistance);
     rootObj.insert("summary", summary);
 
-    QJsonDocument document(rootObj);
-    result = document.toJson();
+    // coordinates are written first, in batches, followed by the other keys
+    // of the root object. This avoids keeping large JSON arrays in memory
+    RouteOutput out(result, sink);
+    out.write("{\"lat\":[");
+    if (!writeCoordinates(out, route_points, true)) return false;
+    out.write("],\"lng\":[");
+    if (!writeCoordinates(out, route_points, false)) return false;
+    out.write("],");
+
+    QByteArray rest = QJsonDocument(rootObj).toJson(QJsonDocument::Compact);
+    out.write(rest.mid(1));
+    out.stream().flush();
 
     return true;
 }
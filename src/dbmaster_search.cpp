@@ -2,6 +2,7 @@
 #include "appsettings.h"
 #include "config.h"
 #include "infohub.h"
+#include "tracer.h"
 
 #include <osmscout/LocationService.h>
 #include <osmscout/TextSearchIndex.h>
@@ -247,7 +248,9 @@ bool DBMaster::search(const QString &searchPattern, SearchResults &all_results,
 {
     if (m_error_flag) return false;
 
+    Tracer::Span span("db wait");
     QMutexLocker lk(&m_mutex);
+    span.next("search");
 
     if (!m_database->IsOpen())
     {
@@ -504,7 +507,9 @@ bool DBMaster::guide(const QString &poitype, double lat, double lon, double radi
 {
     if (m_error_flag) return false;
 
+    Tracer::Span span("db wait");
     QMutexLocker lk(&m_mutex);
+    span.next("guide");
 
     if (!m_database->IsOpen())
     {
@@ -0,0 +1,120 @@
+#include "endpointqueue.h"
+#include "infohub.h"
+
+#include <QMutexLocker>
+
+#include <algorithm>
+
+/// Runs the task and notifies the queue when finished
+class EndpointRunnable: public QRunnable
+{
+public:
+    EndpointRunnable(EndpointQueue *queue, QRunnable *task):
+        QRunnable(),
+        m_queue(queue),
+        m_task(task)
+    {
+    }
+
+    virtual ~EndpointRunnable()
+    {
+        // task is not run if the pool was cleared
+        if (m_task != nullptr && m_task->autoDelete())
+            delete m_task;
+    }
+
+    virtual void run()
+    {
+        m_task->run();
+        if (m_task->autoDelete())
+            delete m_task;
+        m_task = nullptr;
+
+        m_queue->finished();
+    }
+
+protected:
+    EndpointQueue *m_queue;
+    QRunnable *m_task;
+};
+
+EndpointQueue::EndpointQueue(const QString &name):
+    m_name(name)
+{
+}
+
+EndpointQueue::~EndpointQueue()
+{
+    clear();
+}
+
+void EndpointQueue::setup(QThreadPool *pool, int max_running, int max_queued)
+{
+    QMutexLocker lk(&m_mutex);
+    m_pool = pool;
+    m_max_running = (max_running > 0 ? max_running : pool->maxThreadCount());
+    m_max_queued = std::max(0, max_queued);
+}
+
+bool EndpointQueue::start(QRunnable *task)
+{
+    QMutexLocker lk(&m_mutex);
+
+    if (m_running < m_max_running)
+    {
+        m_running++;
+        m_rejecting = false;
+        m_pool->start(new EndpointRunnable(this, task));
+        return true;
+    }
+
+    if ((int)m_queue.size() < m_max_queued)
+    {
+        m_queue.push_back(task);
+        m_rejecting = false;
+        return true;
+    }
+
+    // log only the start of overload
+    if (!m_rejecting)
+        InfoHub::logWarning("Too many requests, rejecting new requests: " + m_name);
+    m_rejecting = true;
+
+    return false;
+}
+
+void EndpointQueue::finished()
+{
+    QMutexLocker lk(&m_mutex);
+
+    if (m_queue.empty())
+    {
+        m_running--;
+        return;
+    }
+
+    QRunnable *task = m_queue.front();
+    m_queue.pop_front();
+    m_pool->start(new EndpointRunnable(this, task));
+}
+
+void EndpointQueue::clear()
+{
+    QMutexLocker lk(&m_mutex);
+    for (QRunnable *task: m_queue)
+        if (task->autoDelete())
+            delete task;
+    m_queue.clear();
+}
+
+int EndpointQueue::running()
+{
+    QMutexLocker lk(&m_mutex);
+    return m_running;
+}
+
+int EndpointQueue::queued()
+{
+    QMutexLocker lk(&m_mutex);
+    return m_queue.size();
+}
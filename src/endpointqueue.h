@@ -0,0 +1,61 @@
+#ifndef ENDPOINTQUEUE_H
+#define ENDPOINTQUEUE_H
+
+#include <QMutex>
+#include <QRunnable>
+#include <QString>
+#include <QThreadPool>
+
+#include <deque>
+
+/// \brief Admission control for tasks of one endpoint
+///
+/// Limits the number of tasks of the endpoint that are given to the
+/// thread pool at the same time. Tasks exceeding the limit wait in the
+/// queue of the endpoint and are started when the earlier tasks finish.
+/// If the queue is full, new tasks are rejected. This keeps the latency
+/// bounded under overload: requests are either served in reasonable
+/// time or rejected early. Thread safe.
+class EndpointQueue
+{
+public:
+    /// \param name used in logs
+    explicit EndpointQueue(const QString &name);
+    ~EndpointQueue();
+
+    /// \brief Set limits, has to be called before starting tasks
+    /// \param pool thread pool running the tasks
+    /// \param max_running maximal number of tasks given to the pool, pool size is used if <= 0
+    /// \param max_queued maximal number of tasks waiting in the queue
+    void setup(QThreadPool *pool, int max_running, int max_queued);
+
+    /// \brief Start or queue the task
+    ///
+    /// Returns false if the task was rejected. In this case, the task is
+    /// not deleted and stays owned by the caller
+    bool start(QRunnable *task);
+
+    /// \brief Drop all waiting tasks, used on shutdown
+    void clear();
+
+    int running();
+    int queued();
+
+protected:
+    void finished(); ///< Called by the finished task
+
+    friend class EndpointRunnable;
+
+protected:
+    QString m_name;
+    QThreadPool *m_pool = nullptr;
+    int m_max_running = 1;
+    int m_max_queued = 0;
+
+    QMutex m_mutex;
+    int m_running = 0;
+    std::deque<QRunnable*> m_queue;
+    bool m_rejecting = false;
+};
+
+#endif // ENDPOINTQUEUE_H
@@ -2,6 +2,8 @@
 #include "appsettings.h"
 #include "config.h"
 #include "infohub.h"
+#include "metrics.h"
+#include "tracer.h"
 
 #include <QMutexLocker>
 
@@ -37,10 +39,12 @@ void GeoMaster::onSettingsChanged()
     QString geopath = settings.valueString(GEOMASTER_SETTINGS "geocoder_path");
     if (geopath.length() < 1 || !m_geocoder.load(geopath.toStdString()))
     {
+        Metrics::increment(Metrics::GeocoderOpenErrors);
         InfoHub::logError(tr("Cannot open geocoder database") + ": " + geopath);
         return;
     }
 
+    Metrics::increment(Metrics::GeocoderOpens);
     InfoHub::logInfo(tr("Opened geocoder database") + " " + geopath, true);
 
     m_geocoder.set_max_queries_per_hierarchy(settings.valueInt(GEOMASTER_SETTINGS "max_queries_per_hierarchy"));
@@ -81,6 +85,7 @@ bool GeoMaster::search(const QString &searchPattern, QJsonObject &result, size_t
     }
 
     // parsing with libpostal
+    Tracer::Span span("parse");
     std::vector< GeoNLP::Postal::ParseResult > parsed_query;
     GeoNLP::Postal::ParseResult nonorm;
 
@@ -92,6 +97,7 @@ bool GeoMaster::search(const QString &searchPattern, QJsonObject &result, size_t
     }
 
     // search
+    span.next("geocode");
     m_geocoder.set_max_results(limit);
     std::vector<GeoNLP::Geocoder::GeoResult> search_result;
     if ( !m_geocoder.search(parsed_query, search_result) )
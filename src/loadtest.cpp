@@ -0,0 +1,929 @@
+/// HTTP load generator and latency benchmark
+///
+/// Drives mixed traffic against the server: tile pans, searches, routes
+/// and guide queries in the given proportions. Requests are sent either
+/// in open loop, with Poisson arrivals at the given rate independent of
+/// the responses, or in closed loop, with the given number of requests
+/// in flight. Reports throughput and latency percentiles per endpoint.
+///
+/// The server can be started by the tool on an offline dataset, with
+/// the settings and caches kept in a temporary directory, allowing to
+/// run it without network access and without touching user settings.
+///
+/// Alternatively, requests recorded in the access log of the server are
+/// replayed at the original or changed speed. Latencies recorded in the
+/// log are reported together with the measured ones, and the results can
+/// be compared with the results of an earlier run, such as of another
+/// build of the server.
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QProcess>
+#include <QProcessEnvironment>
+#include <QSettings>
+#include <QTemporaryDir>
+#include <QTimer>
+#include <QUrl>
+#include <QUrlQuery>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <deque>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <vector>
+
+// QNetworkAccessManager opens up to 6 connections per host. Several
+// managers are used to reach the requested concurrency
+#define CONNECTIONS_PER_MANAGER 6
+
+// requests to other endpoints are only sent when replaying the log
+enum Endpoint { EndpointTile = 0, EndpointSearch, EndpointRoute, EndpointGuide, EndpointOther, NumberOfEndpoints };
+
+static const char *endpoint_names[] = { "tile", "search", "route", "guide", "other" };
+
+static Endpoint endpoint(const QString &path)
+{
+    if (path == "/v1/tile") return EndpointTile;
+    if (path == "/v1/search" || path == "/v2/search") return EndpointSearch;
+    if (path == "/v1/route") return EndpointRoute;
+    if (path == "/v1/guide") return EndpointGuide;
+    return EndpointOther;
+}
+
+static int long2tilex(double lon, int z)
+{
+    return (int)(floor((lon + 180.0) / 360.0 * pow(2.0, z)));
+}
+
+static int lat2tiley(double lat, int z)
+{
+    return (int)(floor((1.0 - log( tan(lat * M_PI/180.0) + 1.0 / cos(lat * M_PI/180.0)) / M_PI) / 2.0 * pow(2.0, z)));
+}
+
+static double percentile(const std::vector<double> &sorted, double p)
+{
+    // nearest-rank method
+    if (sorted.empty())
+        return 0;
+    size_t rank = (size_t)ceil(p/100.0 * sorted.size());
+    if (rank > 0) rank--;
+    return sorted[std::min(rank, sorted.size()-1)];
+}
+
+static QJsonObject summary(std::vector<double> &latencies)
+{
+    std::sort(latencies.begin(), latencies.end());
+    double mean = 0;
+    for (double l: latencies) mean += l;
+    if (!latencies.empty()) mean /= latencies.size();
+
+    QJsonObject o;
+    o.insert("mean", mean);
+    o.insert("p50", percentile(latencies, 50));
+    o.insert("p90", percentile(latencies, 90));
+    o.insert("p99", percentile(latencies, 99));
+    o.insert("max", latencies.empty() ? 0.0 : latencies.back());
+    return o;
+}
+
+static void print(const char *title, const QJsonObject &latency)
+{
+    std::cout << "  " << title << " latency ms: mean " << latency.value("mean").toDouble()
+              << " p50 " << latency.value("p50").toDouble()
+              << " p90 " << latency.value("p90").toDouble()
+              << " p99 " << latency.value("p99").toDouble()
+              << " max " << latency.value("max").toDouble() << "\n";
+}
+
+// change of latency percentiles relative to the reference
+static void compare(const char *title, const QJsonObject &latency, const QJsonObject &reference)
+{
+    std::cout << "  " << title << ":";
+    for (const char *p: {"p50", "p90", "p99"})
+    {
+        double a = reference.value(p).toDouble();
+        double b = latency.value(p).toDouble();
+        std::cout << " " << p << " " << a << " -> " << b;
+        if (a > 0)
+            std::cout << " (" << (b >= a ? "+" : "") << round((b - a) / a * 1000) / 10 << "%)";
+    }
+    std::cout << "\n";
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// Sources of the requests
+/////////////////////////////////////////////////////////////////////////////
+
+struct Request
+{
+    Endpoint endpoint = EndpointOther;
+    QString url;          ///< path with query
+    QByteArray body;      ///< sent as POST if not empty
+    qint64 time = -1;     ///< nanoseconds from the start, -1 to send as soon as possible
+    double recorded = -1; ///< latency in milliseconds recorded in the access log
+};
+
+class Source
+{
+public:
+    virtual ~Source() {}
+
+    /// \brief Fill the next request, returns false when there are no more
+    virtual bool next(Request &request) = 0;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// Traffic: composes the requests of the mix
+/////////////////////////////////////////////////////////////////////////////
+
+/// \brief Generates requests in the area around the given center
+///
+/// Tiles are requested as when panning the map: viewport moves by one
+/// tile in a random walk and the tiles that become visible are requested.
+/// Occasionally, the map is zoomed in or out and the whole viewport is
+/// requested. Other requests use random points in the area.
+///
+/// With the rate given, the requests arrive in open loop following
+/// Poisson process.
+class Traffic: public Source
+{
+public:
+    Traffic(double lat, double lon, double radius_km, int zoom,
+            const std::array<double, NumberOfEndpoints> &weights,
+            const QStringList &terms, const QStringList &poitypes,
+            double rate, unsigned int seed):
+        m_lat(lat), m_lon(lon), m_radius(radius_km), m_zoom(zoom), m_base_zoom(zoom),
+        m_terms(terms), m_poitypes(poitypes), m_rate(rate), m_random(seed),
+        m_pick(weights.begin(), weights.end())
+    {
+        resetViewport();
+    }
+
+    virtual bool next(Request &r)
+    {
+        r.endpoint = (Endpoint)m_pick(m_random);
+        r.url = request(r.endpoint);
+        if (m_rate > 0)
+        {
+            std::exponential_distribution<double> interval(m_rate);
+            r.time = m_time;
+            m_time += (qint64)(interval(m_random) * 1e9);
+        }
+        return true;
+    }
+
+protected:
+    QString request(Endpoint e)
+    {
+        QUrlQuery q;
+        QString path;
+        double lat, lon;
+
+        switch (e)
+        {
+        case EndpointTile:
+        {
+            if (m_tiles.empty())
+                pan();
+            std::array<int, 3> t = m_tiles.front();
+            m_tiles.pop_front();
+            path = "/v1/tile";
+            q.addQueryItem("daylight", "1");
+            q.addQueryItem("shift", "0");
+            q.addQueryItem("scale", "1");
+            q.addQueryItem("z", QString::number(t[0]));
+            q.addQueryItem("x", QString::number(t[1]));
+            q.addQueryItem("y", QString::number(t[2]));
+            break;
+        }
+
+        case EndpointSearch:
+            path = "/v2/search";
+            q.addQueryItem("limit", "10");
+            q.addQueryItem("search", any(m_terms));
+            break;
+
+        case EndpointRoute:
+            path = "/v1/route";
+            point(lat, lon);
+            q.addQueryItem("p[0][lat]", QString::number(lat, 'f', 6));
+            q.addQueryItem("p[0][lng]", QString::number(lon, 'f', 6));
+            point(lat, lon);
+            q.addQueryItem("p[1][lat]", QString::number(lat, 'f', 6));
+            q.addQueryItem("p[1][lng]", QString::number(lon, 'f', 6));
+            q.addQueryItem("type", "car");
+            break;
+
+        case EndpointGuide:
+            path = "/v1/guide";
+            point(lat, lon);
+            q.addQueryItem("poitype", any(m_poitypes));
+            q.addQueryItem("lat", QString::number(lat, 'f', 6));
+            q.addQueryItem("lng", QString::number(lon, 'f', 6));
+            q.addQueryItem("radius", "1000");
+            q.addQueryItem("limit", "20");
+            break;
+
+        default:
+            break;
+        }
+
+        return path + "?" + q.toString(QUrl::FullyEncoded);
+    }
+
+    QString any(const QStringList &list)
+    {
+        std::uniform_int_distribution<int> d(0, list.size()-1);
+        return list[d(m_random)];
+    }
+
+    // uniformly distributed random point within the radius
+    void point(double &lat, double &lon)
+    {
+        std::uniform_real_distribution<double> u(0, 1);
+        double r = m_radius * sqrt(u(m_random));
+        double a = 2 * M_PI * u(m_random);
+        lat = m_lat + r * cos(a) / 111.0;
+        lon = m_lon + r * sin(a) / (111.0 * cos(m_lat * M_PI / 180.0));
+    }
+
+    void resetViewport()
+    {
+        m_x = long2tilex(m_lon, m_zoom);
+        m_y = lat2tiley(m_lat, m_zoom);
+        m_tiles.clear();
+        for (int i=0; i < Viewport; ++i)
+            for (int j=0; j < Viewport; ++j)
+                m_tiles.push_back({m_zoom, m_x + i, m_y + j});
+    }
+
+    void pan()
+    {
+        std::uniform_real_distribution<double> u(0, 1);
+        if (u(m_random) < 0.05)
+        {
+            // zoom in or out around the center of the area
+            m_zoom = std::max(m_base_zoom - 2, std::min(m_base_zoom + 2, m_zoom + (u(m_random) < 0.5 ? -1 : 1)));
+            resetViewport();
+            return;
+        }
+
+        // random walk, kept within the area
+        int x0 = long2tilex(m_lon - m_radius / (111.0 * cos(m_lat * M_PI / 180.0)), m_zoom);
+        int x1 = long2tilex(m_lon + m_radius / (111.0 * cos(m_lat * M_PI / 180.0)), m_zoom);
+        int y0 = lat2tiley(m_lat + m_radius / 111.0, m_zoom);
+        int y1 = lat2tiley(m_lat - m_radius / 111.0, m_zoom);
+
+        int dir = (int)(u(m_random) * 4);
+        int dx = (dir == 0 ? 1 : (dir == 1 ? -1 : 0));
+        int dy = (dir == 2 ? 1 : (dir == 3 ? -1 : 0));
+        if (m_x + dx < x0 || m_x + dx + Viewport - 1 > x1) dx = -dx;
+        if (m_y + dy < y0 || m_y + dy + Viewport - 1 > y1) dy = -dy;
+
+        m_x += dx;
+        m_y += dy;
+
+        // newly visible row or column
+        for (int k=0; k < Viewport; ++k)
+        {
+            if (dx > 0) m_tiles.push_back({m_zoom, m_x + Viewport - 1, m_y + k});
+            if (dx < 0) m_tiles.push_back({m_zoom, m_x, m_y + k});
+            if (dy > 0) m_tiles.push_back({m_zoom, m_x + k, m_y + Viewport - 1});
+            if (dy < 0) m_tiles.push_back({m_zoom, m_x + k, m_y});
+        }
+    }
+
+protected:
+    static const int Viewport = 4; ///< viewport size in tiles
+
+    double m_lat;
+    double m_lon;
+    double m_radius;
+    int m_zoom;
+    int m_base_zoom;
+    QStringList m_terms;
+    QStringList m_poitypes;
+    double m_rate;
+    qint64 m_time = 0;
+
+    std::mt19937 m_random;
+    std::discrete_distribution<int> m_pick;
+
+    int m_x = 0;
+    int m_y = 0;
+    std::deque< std::array<int, 3> > m_tiles;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// Replay of the access log
+/////////////////////////////////////////////////////////////////////////////
+
+/// \brief Requests read from the access logs of the server
+///
+/// Logs of several worker processes are merged by time. Requests are
+/// scheduled at their original times divided by the speed. With speed 0,
+/// requests are sent as soon as possible.
+class Replay: public Source
+{
+public:
+    bool load(const QString &fname)
+    {
+        QFile file(fname);
+        if (!file.open(QIODevice::ReadOnly))
+            return false;
+
+        while (!file.atEnd())
+        {
+            QJsonObject o = QJsonDocument::fromJson(file.readLine()).object();
+            if (o.isEmpty())
+                continue;
+
+            Entry e;
+            e.time = (qint64)o.value("time").toDouble();
+            e.request.endpoint = endpoint(o.value("path").toString());
+            e.request.body = o.value("body").toString().toUtf8();
+            e.request.recorded = o.value("status").toInt() == 200 ? o.value("latencyMs").toDouble(-1) : -1;
+
+            // arguments are logged decoded
+            QStringList query;
+            QJsonObject args = o.value("args").toObject();
+            for (auto i = args.constBegin(); i != args.constEnd(); ++i)
+                query.append(QUrl::toPercentEncoding(i.key()) + "=" +
+                             QUrl::toPercentEncoding(i.value().toString()));
+            e.request.url = o.value("path").toString();
+            if (!query.isEmpty())
+                e.request.url += "?" + query.join('&');
+
+            m_entries.push_back(e);
+        }
+
+        std::stable_sort(m_entries.begin(), m_entries.end(),
+                         [](const Entry &a, const Entry &b){ return a.time < b.time; });
+        return true;
+    }
+
+    void setSpeed(double speed) { m_speed = speed; }
+
+    size_t size() const { return m_entries.size(); }
+
+    virtual bool next(Request &r)
+    {
+        if (m_next >= m_entries.size())
+            return false;
+
+        const Entry &e = m_entries[m_next++];
+        r = e.request;
+        if (m_speed > 0)
+            r.time = (qint64)((e.time - m_entries.front().time) * 1e6 / m_speed);
+        return true;
+    }
+
+protected:
+    struct Entry
+    {
+        qint64 time; ///< milliseconds since epoch
+        Request request;
+    };
+
+    std::vector<Entry> m_entries;
+    size_t m_next = 0;
+    double m_speed = 1;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// Load generator
+/////////////////////////////////////////////////////////////////////////////
+
+struct Stats
+{
+    std::vector<double> latencies; ///< milliseconds, successful requests
+    std::vector<double> recorded;  ///< milliseconds, recorded in access log for the same requests
+    size_t sent = 0;
+    size_t rejected = 0;           ///< HTTP 503, server overload
+    size_t errors = 0;             ///< other HTTP errors and network failures
+    size_t dropped = 0;            ///< not sent, concurrency limit reached in open loop
+    size_t bytes = 0;
+};
+
+/// \brief Sends requests and collects their latencies
+///
+/// Requests with scheduled time are sent in open loop and their latency
+/// is measured from the scheduled time, so that delays in sending caused
+/// by the overload are included. Other requests are sent in closed loop
+/// keeping the given number of them in flight. Sending stops after the
+/// duration, if given, or when the source has no more requests.
+class LoadGenerator
+{
+public:
+    LoadGenerator(const QUrl &base, Source &source, int concurrency,
+                  double warmup, double duration):
+        m_base(base), m_source(source), m_concurrency(concurrency)
+    {
+        int managers = (concurrency + CONNECTIONS_PER_MANAGER - 1) / CONNECTIONS_PER_MANAGER;
+        for (int i=0; i < std::max(1, managers); ++i)
+            m_managers.emplace_back(new QNetworkAccessManager);
+
+        m_warmup_end = (qint64)(warmup * 1e9);
+        m_end = (duration > 0 ? m_warmup_end + (qint64)(duration * 1e9) :
+                                std::numeric_limits<qint64>::max());
+
+        m_timer.setSingleShot(true);
+        m_timer.setTimerType(Qt::PreciseTimer);
+        QObject::connect(&m_timer, &QTimer::timeout, [this](){ arrivals(); });
+    }
+
+    void run()
+    {
+        m_clock.start();
+
+        m_sending = m_source.next(m_pending);
+        if (!m_sending)
+            return;
+
+        if (m_pending.time >= 0)
+            arrivals();
+        else
+        {
+            send(m_pending);
+            for (int i=1; i < m_concurrency && m_sending; ++i)
+                sendNext();
+        }
+
+        if (m_sending || m_in_flight > 0)
+            m_loop.exec();
+    }
+
+    const std::array<Stats, NumberOfEndpoints>& stats() const { return m_stats; }
+    double measuredSeconds() const { return std::max<qint64>(1, m_stopped - m_warmup_end) * 1e-9; }
+
+protected:
+    // open loop: sends all requests due by now and schedules the next
+    void arrivals()
+    {
+        qint64 now = m_clock.nsecsElapsed();
+        while (m_sending && m_pending.time <= now && m_pending.time < m_end)
+        {
+            if (m_in_flight < m_concurrency)
+                send(m_pending);
+            else if (m_pending.time >= m_warmup_end)
+                m_stats[m_pending.endpoint].dropped++;
+
+            m_sending = m_source.next(m_pending);
+        }
+
+        if (m_sending && m_pending.time < m_end)
+            m_timer.start((int)std::max<qint64>(0, (m_pending.time - now) / 1000000));
+        else
+            stop();
+    }
+
+    // closed loop: sends the next request when the previous one is done
+    void sendNext()
+    {
+        Request r;
+        if (m_clock.nsecsElapsed() >= m_end || !m_source.next(r))
+        {
+            stop();
+            return;
+        }
+        send(r);
+    }
+
+    void send(const Request &r)
+    {
+        QNetworkAccessManager *manager = m_managers[m_next_manager].get();
+        m_next_manager = (m_next_manager + 1) % m_managers.size();
+
+        QNetworkRequest request(QUrl(m_base.toString() + r.url));
+        qint64 scheduled = (r.time >= 0 ? r.time : m_clock.nsecsElapsed());
+        bool closed_loop = (r.time < 0);
+
+        m_in_flight++;
+        QNetworkReply *reply;
+        if (r.body.isEmpty())
+            reply = manager->get(request);
+        else
+        {
+            request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
+            reply = manager->post(request, r.body);
+        }
+
+        Endpoint e = r.endpoint;
+        double recorded = r.recorded;
+        QObject::connect(reply, &QNetworkReply::finished, [this, reply, e, recorded, scheduled, closed_loop]() {
+            qint64 now = m_clock.nsecsElapsed();
+            int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+            QByteArray data = reply->readAll();
+            reply->deleteLater();
+            m_in_flight--;
+
+            if (scheduled >= m_warmup_end && scheduled < m_end)
+            {
+                Stats &s = m_stats[e];
+                s.sent++;
+                if (status == 200 && reply->error() == QNetworkReply::NoError)
+                {
+                    s.latencies.push_back((now - scheduled) * 1e-6);
+                    s.bytes += data.size();
+                    if (recorded >= 0)
+                        s.recorded.push_back(recorded);
+                }
+                else if (status == 503) s.rejected++;
+                else s.errors++;
+            }
+
+            if (closed_loop && m_sending)
+                sendNext();
+            else
+                finishIfDone();
+        });
+    }
+
+    void stop()
+    {
+        if (m_sending || m_stopped == 0)
+            m_stopped = std::min(m_clock.nsecsElapsed(), m_end);
+        m_sending = false;
+        finishIfDone();
+    }
+
+    void finishIfDone()
+    {
+        if (!m_sending && m_in_flight == 0)
+            m_loop.quit();
+    }
+
+protected:
+    QUrl m_base;
+    Source &m_source;
+    int m_concurrency;
+
+    std::vector< std::unique_ptr<QNetworkAccessManager> > m_managers;
+    size_t m_next_manager = 0;
+
+    QElapsedTimer m_clock;
+    QTimer m_timer;
+    QEventLoop m_loop;
+
+    qint64 m_warmup_end;
+    qint64 m_end;
+    qint64 m_stopped = 0;
+    Request m_pending; ///< next request in open loop
+    bool m_sending = false;
+    int m_in_flight = 0;
+
+    std::array<Stats, NumberOfEndpoints> m_stats;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// Server started for the test
+/////////////////////////////////////////////////////////////////////////////
+
+static bool get(const QUrl &url, QByteArray &data, int timeout_ms)
+{
+    QNetworkAccessManager manager;
+    QNetworkReply *reply = manager.get(QNetworkRequest(url));
+
+    QEventLoop loop;
+    QTimer::singleShot(timeout_ms, &loop, &QEventLoop::quit);
+    QObject::connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
+    loop.exec();
+
+    bool ok = reply->isFinished() && reply->error() == QNetworkReply::NoError;
+    if (ok) data = reply->readAll();
+    else reply->abort();
+    reply->deleteLater();
+    return ok;
+}
+
+/// \brief Starts the server with settings and caches in a temporary directory
+///
+/// Map Manager is told not to manage the database paths, the map is set
+/// directly. Geocoder-NLP is not used, search is done by libosmscout
+static bool start_server(QProcess &server, const QTemporaryDir &dir, const QString &exe,
+                         const QCommandLineParser &parser, int port, bool verbose)
+{
+    QString config = dir.path() + "/config";
+    {
+        QSettings settings(config + "/osmscout-server/osmscout-server.conf", QSettings::IniFormat);
+        settings.setValue("http-listener/host", "127.0.0.1");
+        settings.setValue("http-listener/port", port);
+        settings.setValue("maps/manage_paths", 0);
+        settings.setValue("libosmscout/map", parser.value("map"));
+        settings.setValue("libosmscout/mapOverview", parser.value("overview"));
+        settings.setValue("libosmscout/logInfo", verbose ? 1 : 0);
+        settings.setValue("geocoder-nlp/use_geocoder_nlp", 0);
+        if (parser.isSet("style"))
+            settings.setValue("libosmscout/style", parser.value("style"));
+        if (parser.isSet("icons"))
+            settings.setValue("libosmscout/icons", parser.value("icons"));
+
+        for (const QString &s: parser.values("set"))
+        {
+            int i = s.indexOf('=');
+            if (i > 0) settings.setValue(s.left(i), s.mid(i+1));
+        }
+    }
+
+    QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
+    env.insert("XDG_CONFIG_HOME", config);
+    env.insert("XDG_CACHE_HOME", dir.path() + "/cache");
+    env.insert("XDG_DATA_HOME", dir.path() + "/data");
+    server.setProcessEnvironment(env);
+    server.setWorkingDirectory(dir.path());
+    if (verbose)
+        server.setProcessChannelMode(QProcess::ForwardedChannels);
+    else
+        server.setStandardOutputFile(dir.path() + "/server.log");
+
+    server.start(exe, QStringList());
+    return server.waitForStarted();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("osmscout-server-loadtest");
+    app.setOrganizationName("osmscout-server");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("HTTP load generator for OSM Scout Server");
+    parser.addHelpOption();
+
+    QCommandLineOption optUrl("url", "Address of a running server", "url", "http://127.0.0.1:8553");
+    QCommandLineOption optServer("server", "Start the server executable for the test", "exe");
+    QCommandLineOption optMap("map", "Directory with libosmscout map, for started server", "dir");
+    QCommandLineOption optOverview("overview", "Directory with overview map, for started server", "dir");
+    QCommandLineOption optStyle("style", "Map style, for started server", "file");
+    QCommandLineOption optIcons("icons", "Directory with icons, for started server", "dir");
+    QCommandLineOption optSet("set", "Server setting given as key=value, for started server", "setting");
+    QCommandLineOption optPort("port", "Port of the started server", "port", "18553");
+    QCommandLineOption optCenter("center", "Center of the area as lat,lon", "lat,lon", "59.44,24.64");
+    QCommandLineOption optRadius("radius", "Radius of the area in km", "km", "3");
+    QCommandLineOption optZoom("zoom", "Zoom level of the panned map", "z", "15");
+    QCommandLineOption optMix("mix", "Traffic mix in relative weights", "mix", "tile=70,search=10,route=10,guide=10");
+    QCommandLineOption optTerms("search", "Comma-separated search terms", "terms",
+                                "Synthetic City,Street 5,Avenue 12,Suburb 1,Park 0-0");
+    QCommandLineOption optPoi("poitypes", "Comma-separated POI types for guide", "types", "park,building,place");
+    QCommandLineOption optRate("rate", "Open loop arrival rate in requests per second, 0 for closed loop", "rps", "0");
+    QCommandLineOption optConcurrency("concurrency", "Maximal number of requests in flight", "n", "16");
+    QCommandLineOption optDuration("duration", "Duration of measurements in seconds", "s", "30");
+    QCommandLineOption optWarmup("warmup", "Duration of warmup in seconds, not included in results", "s", "5");
+    QCommandLineOption optSeed("seed", "Random seed", "n", "1");
+    QCommandLineOption optJson("json", "Write results as JSON into file, '-' for standard output", "file");
+    QCommandLineOption optMetrics("metrics", "Save server metrics after the test into file", "file");
+    QCommandLineOption optReplay("replay", "Replay requests from access log instead of generating them, can be given several times", "file");
+    QCommandLineOption optSpeed("speed", "Replay speed relative to the original, 0 for closed loop", "factor", "1");
+    QCommandLineOption optCompare("compare", "Compare latencies with the results saved earlier by --json", "file");
+    QCommandLineOption optVerbose("verbose", "Print server output");
+    parser.addOptions({optUrl, optServer, optMap, optOverview, optStyle, optIcons, optSet, optPort,
+                       optCenter, optRadius, optZoom, optMix, optTerms, optPoi,
+                       optRate, optConcurrency, optDuration, optWarmup, optSeed,
+                       optReplay, optSpeed, optCompare,
+                       optJson, optMetrics, optVerbose});
+
+    parser.process(app);
+
+    QStringList center = parser.value(optCenter).split(',');
+    if (center.size() != 2)
+    {
+        std::cerr << "Wrong center: " << parser.value(optCenter).toStdString() << std::endl;
+        return -1;
+    }
+
+    std::array<double, NumberOfEndpoints> weights;
+    weights.fill(0);
+    for (const QString &m: parser.value(optMix).split(',', QString::SkipEmptyParts))
+    {
+        QStringList kv = m.split('=');
+        int e = 0;
+        while (e < EndpointOther && (kv.size() != 2 || kv[0].trimmed() != endpoint_names[e]))
+            ++e;
+        if (e == EndpointOther)
+        {
+            std::cerr << "Wrong traffic mix: " << m.toStdString() << std::endl;
+            return -1;
+        }
+        weights[e] = std::max(0.0, kv[1].toDouble());
+    }
+
+    if (std::all_of(weights.begin(), weights.end(), [](double w){ return w <= 0; }))
+    {
+        std::cerr << "Traffic mix is empty" << std::endl;
+        return -1;
+    }
+
+    int concurrency = std::max(1, parser.value(optConcurrency).toInt());
+    double rate = std::max(0.0, parser.value(optRate).toDouble());
+    double duration = std::max(1.0, parser.value(optDuration).toDouble());
+    double warmup = std::max(0.0, parser.value(optWarmup).toDouble());
+    unsigned int seed = parser.value(optSeed).toUInt();
+    bool verbose = parser.isSet(optVerbose);
+
+    // replay runs until the end of the log, unless the duration is given
+    bool replaying = parser.isSet(optReplay);
+    double speed = std::max(0.0, parser.value(optSpeed).toDouble());
+    Replay replay;
+    if (replaying)
+    {
+        if (!parser.isSet(optDuration))
+            duration = 0;
+
+        for (const QString &fname: parser.values(optReplay))
+            if (!replay.load(fname))
+            {
+                std::cerr << "Failed to read access log: " << fname.toStdString() << std::endl;
+                return -1;
+            }
+        replay.setSpeed(speed);
+    }
+
+    QJsonObject reference;
+    if (parser.isSet(optCompare))
+    {
+        QFile file(parser.value(optCompare));
+        if (!file.open(QIODevice::ReadOnly))
+        {
+            std::cerr << "Failed to read results: " << parser.value(optCompare).toStdString() << std::endl;
+            return -1;
+        }
+        reference = QJsonDocument::fromJson(file.readAll()).object().value("endpoints").toObject();
+    }
+
+    // server
+    QUrl base(parser.value(optUrl));
+    QProcess server;
+    QTemporaryDir tmpdir;
+
+    if (parser.isSet(optServer))
+    {
+        if (!parser.isSet(optMap))
+        {
+            std::cerr << "Map has to be given for the started server" << std::endl;
+            return -1;
+        }
+
+        int port = parser.value(optPort).toInt();
+        base = QUrl("http://127.0.0.1:" + QString::number(port));
+
+        if (!tmpdir.isValid() ||
+                !start_server(server, tmpdir, parser.value(optServer), parser, port, verbose))
+        {
+            std::cerr << "Failed to start server: " << parser.value(optServer).toStdString() << std::endl;
+            return -2;
+        }
+    }
+
+    // wait until the server answers. Databases are opened before the
+    // server starts listening
+    {
+        QElapsedTimer timer;
+        timer.start();
+        QByteArray data;
+        bool ready = false;
+        while ( !ready && timer.elapsed() < 60000 &&
+                (!parser.isSet(optServer) || server.state() == QProcess::Running) )
+        {
+            ready = get(QUrl(base.toString() + "/v1/metrics"), data, 1000);
+            if (!ready)
+            {
+                QEventLoop loop;
+                QTimer::singleShot(200, &loop, &QEventLoop::quit);
+                loop.exec();
+            }
+        }
+
+        if (!ready)
+        {
+            std::cerr << "Server is not responding at " << base.toString().toStdString() << std::endl;
+            return -2;
+        }
+    }
+
+    Traffic traffic(center[0].toDouble(), center[1].toDouble(),
+                    std::max(0.1, parser.value(optRadius).toDouble()),
+                    parser.value(optZoom).toInt(), weights,
+                    parser.value(optTerms).split(',', QString::SkipEmptyParts),
+                    parser.value(optPoi).split(',', QString::SkipEmptyParts),
+                    rate, seed);
+
+    Source *source = &traffic;
+    if (replaying) source = &replay;
+
+    LoadGenerator generator(base, *source, concurrency, warmup, duration);
+    generator.run();
+
+    // server metrics after the run, to relate latencies to cache hits and queues
+    if (parser.isSet(optMetrics))
+    {
+        QByteArray data;
+        QFile file(parser.value(optMetrics));
+        if ( !get(QUrl(base.toString() + "/v1/metrics"), data, 10000) ||
+             !file.open(QIODevice::WriteOnly | QIODevice::Truncate) ||
+             file.write(data) != data.size() )
+            std::cerr << "Failed to save server metrics: " << parser.value(optMetrics).toStdString() << std::endl;
+    }
+
+    if (parser.isSet(optServer))
+    {
+        server.terminate();
+        if (!server.waitForFinished(10000))
+            server.kill();
+    }
+
+    // report
+    bool open_loop = (replaying ? speed > 0 : rate > 0);
+    double seconds = generator.measuredSeconds();
+    QJsonObject root;
+    root.insert("url", base.toString());
+    root.insert("mode", open_loop ? "open" : "closed");
+    root.insert("concurrency", concurrency);
+    root.insert("seconds", seconds);
+    if (replaying)
+    {
+        root.insert("replayed", (double)replay.size());
+        root.insert("speed", speed);
+        std::cout << "Replay of " << replay.size() << " requests at speed " << speed;
+    }
+    else
+    {
+        root.insert("rate", rate);
+        std::cout << (open_loop ? "Open loop, " + std::to_string(rate) + " requests/s" : std::string("Closed loop"));
+    }
+    std::cout << ", concurrency " << concurrency << ", " << seconds << " s\n";
+
+    size_t errors = 0;
+    QJsonObject endpoints;
+    for (int e=0; e < NumberOfEndpoints; ++e)
+    {
+        Stats s = generator.stats()[e];
+        if (s.sent == 0 && s.dropped == 0)
+            continue;
+
+        errors += s.errors;
+
+        QJsonObject o;
+        o.insert("sent", (double)s.sent);
+        o.insert("ok", (double)s.latencies.size());
+        o.insert("rejected", (double)s.rejected);
+        o.insert("errors", (double)s.errors);
+        o.insert("dropped", (double)s.dropped);
+        o.insert("requestsPerSecond", s.latencies.size() / seconds);
+        o.insert("meanBytes", s.latencies.empty() ? 0.0 : (double)s.bytes / s.latencies.size());
+        o.insert("latencyMs", summary(s.latencies));
+        if (!s.recorded.empty())
+            o.insert("recordedLatencyMs", summary(s.recorded));
+        endpoints.insert(endpoint_names[e], o);
+
+        std::cout << endpoint_names[e] << ": ok " << s.latencies.size()
+                  << " rejected " << s.rejected << " errors " << s.errors << " dropped " << s.dropped
+                  << ", " << s.latencies.size() / seconds << " requests/s\n";
+        print("measured", o.value("latencyMs").toObject());
+        if (!s.recorded.empty())
+        {
+            print("recorded", o.value("recordedLatencyMs").toObject());
+            compare("recorded -> measured", o.value("latencyMs").toObject(),
+                    o.value("recordedLatencyMs").toObject());
+        }
+        if (reference.contains(endpoint_names[e]))
+            compare("reference -> measured", o.value("latencyMs").toObject(),
+                    reference.value(endpoint_names[e]).toObject().value("latencyMs").toObject());
+    }
+    root.insert("endpoints", endpoints);
+    std::cout << std::flush;
+
+    if (parser.isSet(optJson))
+    {
+        QByteArray json = QJsonDocument(root).toJson();
+        QString fname = parser.value(optJson);
+        if (fname == "-")
+            std::cout << json.toStdString() << std::flush;
+        else
+        {
+            QFile file(fname);
+            if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) ||
+                    file.write(json) != json.size())
+            {
+                std::cerr << "Failed to write results: " << fname.toStdString() << std::endl;
+                return -3;
+            }
+        }
+    }
+
+    return errors > 0 ? 1 : 0;
+}
@@ -0,0 +1,285 @@
+#include "localserver.h"
+#include "requestmapper.h"
+#include "infohub.h"
+
+#include <QMutexLocker>
+#include <QUrl>
+#include <QUrlQuery>
+#include <QCoreApplication>
+
+#include <algorithm>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//////////////////////////////////////////////////////////////////////////////
+/// Shared memory
+
+LocalServer::SharedBuffer::SharedBuffer(const std::string &name, int slot_count, int slot_size):
+    m_name(name),
+    m_busy(slot_count, false),
+    m_slot_size(slot_size)
+{
+    int fd = shm_open(m_name.c_str(), O_CREAT | O_EXCL | O_RDWR, S_IRUSR | S_IWUSR);
+    if (fd < 0)
+        return;
+
+    m_size = (size_t)slot_count * (size_t)slot_size;
+    if (ftruncate(fd, m_size) != 0)
+    {
+        close(fd);
+        shm_unlink(m_name.c_str());
+        return;
+    }
+
+    void *p = mmap(NULL, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (p == MAP_FAILED)
+    {
+        shm_unlink(m_name.c_str());
+        return;
+    }
+
+    m_data = (char*)p;
+}
+
+LocalServer::SharedBuffer::~SharedBuffer()
+{
+    if (m_data == nullptr)
+        return;
+
+    munmap(m_data, m_size);
+    shm_unlink(m_name.c_str());
+}
+
+int LocalServer::SharedBuffer::write(const QByteArray &data)
+{
+    if (m_data == nullptr || data.size() > m_slot_size)
+        return -1;
+
+    int slot = -1;
+    {
+        QMutexLocker lk(&m_mutex);
+        for (int i=0; i < m_busy.size() && slot < 0; ++i)
+            if (!m_busy[i])
+            {
+                m_busy[i] = true;
+                slot = i;
+            }
+    }
+
+    // slot is reserved for this response, copy can be done without locking
+    if (slot >= 0)
+        memcpy(m_data + (size_t)slot * (size_t)m_slot_size, data.constData(), data.size());
+
+    return slot;
+}
+
+void LocalServer::SharedBuffer::release(int slot)
+{
+    QMutexLocker lk(&m_mutex);
+    if (slot >= 0 && slot < m_busy.size())
+        m_busy[slot] = false;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+/// Response assembly
+///
+/// Response can be submitted by RequestMapper before the status and content
+/// type are known (synchronous replies) or later from the worker thread. The
+/// response is sent when both parts are available.
+
+namespace {
+struct PendingReply
+{
+    QMutex mutex;
+    bool has_status = false;
+    bool has_data = false;
+    bool failed = false;
+    unsigned int status = 0;
+    QString content_type;
+    QByteArray data;
+};
+}
+
+//////////////////////////////////////////////////////////////////////////////
+/// Local server
+
+LocalServer::LocalServer(RequestMapper *service, QObject *parent) :
+    QObject(parent),
+    m_service(service)
+{
+    connect(&m_server, &QLocalServer::newConnection, this, &LocalServer::onNewConnection);
+    connect(this, &LocalServer::replyReady, this, &LocalServer::onReplyReady, Qt::QueuedConnection);
+}
+
+LocalServer::~LocalServer()
+{
+    m_server.close();
+
+    QList<Client> clients = m_clients.values();
+    m_clients.clear();
+    for (Client &c: clients)
+    {
+        c.socket->disconnect(this);
+        c.socket->abort();
+        delete c.socket;
+    }
+}
+
+bool LocalServer::start(const QString &socket_path, int slot_count, int slot_size)
+{
+    m_slot_count = std::max(1, slot_count);
+    m_slot_size = std::max(4096, slot_size);
+
+    QLocalServer::removeServer(socket_path);
+    m_server.setSocketOptions(QLocalServer::UserAccessOption);
+    if (!m_server.listen(socket_path))
+    {
+        InfoHub::logError(tr("Cannot start local server") + ": " + m_server.errorString());
+        return false;
+    }
+
+    InfoHub::logInfo(tr("Local server listening on") + " " + m_server.fullServerName());
+    return true;
+}
+
+void LocalServer::onNewConnection()
+{
+    QLocalSocket *socket;
+    while ( (socket = m_server.nextPendingConnection()) != nullptr )
+    {
+        quint64 id = ++m_next_client;
+
+        std::string name = "/osmscout-server-" + std::to_string(QCoreApplication::applicationPid()) +
+                "-" + std::to_string(id);
+
+        Client c;
+        c.socket = socket;
+        c.buffer = std::make_shared<SharedBuffer>(name, m_slot_count, m_slot_size);
+
+        socket->setProperty("client", id);
+        connect(socket, &QLocalSocket::readyRead, this, &LocalServer::onReadyRead);
+        connect(socket, &QLocalSocket::disconnected, this, &LocalServer::onDisconnected);
+
+        m_clients.insert(id, c);
+
+        // if shared memory is not available, all responses are sent inline
+        QByteArray hello = "SHM ";
+        if (c.buffer->isValid())
+            hello += QByteArray::fromStdString(name) + " " + QByteArray::number(m_slot_count) + " " +
+                    QByteArray::number(m_slot_size);
+        else
+            hello += "- 0 0";
+
+        socket->write(hello + "\n");
+    }
+}
+
+void LocalServer::onDisconnected()
+{
+    QLocalSocket *socket = qobject_cast<QLocalSocket*>(sender());
+    if (socket == nullptr)
+        return;
+
+    // shared memory is released when the last response in flight is done
+    m_clients.remove(socket->property("client").toULongLong());
+    socket->deleteLater();
+}
+
+void LocalServer::onReadyRead()
+{
+    QLocalSocket *socket = qobject_cast<QLocalSocket*>(sender());
+    if (socket == nullptr)
+        return;
+
+    quint64 client_id = socket->property("client").toULongLong();
+    while (socket->canReadLine())
+    {
+        QByteArray line = socket->readLine().trimmed();
+        if (line.isEmpty())
+            continue;
+
+        if (line.startsWith("R "))
+        {
+            auto iter = m_clients.find(client_id);
+            if (iter != m_clients.end())
+                iter->buffer->release(line.mid(2).toInt());
+        }
+        else
+            processRequest(client_id, line);
+    }
+}
+
+void LocalServer::processRequest(quint64 client_id, const QByteArray &line)
+{
+    auto iter = m_clients.find(client_id);
+    if (iter == m_clients.end())
+        return;
+
+    int sep = line.indexOf(' ');
+    if (sep < 0)
+        return;
+
+    QByteArray request_id = line.left(sep);
+
+    // '+' denotes space in query, as in HTTP
+    QByteArray urlbytes = line.mid(sep+1);
+    urlbytes.replace('+', "%20");
+    QUrl url(QString::fromUtf8(urlbytes));
+
+    RequestMapper::Arguments args;
+    for (const auto &item: QUrlQuery(url).queryItems(QUrl::FullyDecoded))
+        if (!args.contains(item.first))
+            args.insert(item.first, item.second);
+
+    std::shared_ptr<SharedBuffer> buffer = iter->buffer;
+    std::shared_ptr<PendingReply> pending = std::make_shared<PendingReply>();
+
+    // composes and sends response when both data and status are available
+    auto send = [this, client_id, request_id, buffer](PendingReply &p) {
+        QByteArray ct = p.content_type.toUtf8();
+        int slot = buffer->write(p.data);
+        unsigned int status = ( p.failed ? MHD_HTTP_INTERNAL_SERVER_ERROR : p.status );
+        QByteArray message = request_id + " " + QByteArray::number(status) + " ";
+        if (slot >= 0)
+            message += "shm " + QByteArray::number(slot) + " " +
+                    QByteArray::number(p.data.size()) + " " + ct + "\n";
+        else
+            message += "inline " + QByteArray::number(p.data.size()) + " " + ct + "\n" + p.data;
+
+        p.data.clear();
+        emit replyReady(client_id, message);
+    };
+
+    RequestMapper::Reply reply = [pending, send](QByteArray &data, bool error) {
+        QMutexLocker lk(&pending->mutex);
+        pending->data = data;
+        pending->has_data = true;
+        pending->failed = error;
+        if (pending->has_status)
+            send(*pending);
+    };
+
+    QString content_type;
+    unsigned int status = m_service->dispatch(url.path(), args, reply, content_type);
+
+    QMutexLocker lk(&pending->mutex);
+    pending->status = status;
+    pending->content_type = content_type;
+    pending->has_status = true;
+    if (pending->has_data)
+        send(*pending);
+}
+
+void LocalServer::onReplyReady(quint64 client, QByteArray message)
+{
+    auto iter = m_clients.find(client);
+    if (iter == m_clients.end())
+        return;
+
+    iter->socket->write(message);
+}
@@ -0,0 +1,107 @@
+#ifndef LOCALSERVER_H
+#define LOCALSERVER_H
+
+#include <QObject>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QByteArray>
+#include <QString>
+#include <QHash>
+#include <QMutex>
+#include <QVector>
+
+#include <memory>
+#include <string>
+
+class RequestMapper;
+
+/// \brief Transport for clients running on the same device
+///
+/// Requests are received through Unix domain socket and are dispatched
+/// by RequestMapper in the same way as HTTP requests. Each client gets
+/// its own POSIX shared memory segment split into slots. Responses are
+/// written into a free slot and only a short notification is sent through
+/// the socket. If there is no free slot or the response does not fit into
+/// a slot, the response is sent through the socket.
+///
+/// Protocol, all control messages are lines terminated by '\n':
+///  - server, on connection: "SHM <name> <number of slots> <slot size>"
+///  - client request: "<id> <path with query>", as in HTTP URL
+///  - server response: "<id> <status> shm <slot> <size> <content type>" or
+///    "<id> <status> inline <size> <content type>" followed by the data
+///  - client, when the data in the slot has been read: "R <slot>"
+///
+class LocalServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit LocalServer(RequestMapper *service, QObject *parent = 0);
+    virtual ~LocalServer();
+
+    /// \brief Start listening on socket
+    ///
+    /// \param socket_path full path of the socket
+    /// \param slot_count number of slots in shared memory of each client
+    /// \param slot_size size of each slot in bytes
+    /// \return true on success
+    bool start(const QString &socket_path, int slot_count, int slot_size);
+
+    operator bool() const { return m_server.isListening(); }
+
+signals:
+    /// Used internally to pass responses from worker threads
+    void replyReady(quint64 client, QByteArray message);
+
+protected slots:
+    void onNewConnection();
+    void onReadyRead();
+    void onDisconnected();
+    void onReplyReady(quint64 client, QByteArray message);
+
+protected:
+    /// \brief Shared memory segment split into slots
+    class SharedBuffer
+    {
+    public:
+        SharedBuffer(const std::string &name, int slot_count, int slot_size);
+        ~SharedBuffer();
+
+        bool isValid() const { return m_data != nullptr; }
+
+        const std::string& name() const { return m_name; }
+        int slotCount() const { return m_busy.size(); }
+        int slotSize() const { return m_slot_size; }
+
+        int write(const QByteArray &data); ///< Copies data into a free slot, returns slot or -1 if failed
+        void release(int slot);
+
+    protected:
+        QMutex m_mutex;
+        std::string m_name;
+        QVector<bool> m_busy;
+        int m_slot_size;
+        char *m_data = nullptr;
+        size_t m_size = 0;
+    };
+
+    struct Client
+    {
+        QLocalSocket *socket;
+        std::shared_ptr<SharedBuffer> buffer;
+    };
+
+    void processRequest(quint64 client_id, const QByteArray &line);
+
+protected:
+    RequestMapper *m_service;
+    QLocalServer m_server;
+
+    int m_slot_count = 0;
+    int m_slot_size = 0;
+
+    quint64 m_next_client = 0;
+    QHash<quint64, Client> m_clients;
+};
+
+#endif // LOCALSERVER_H
@@ -17,6 +17,11 @@
 
 #define APP_PREFIX ""
 
+#include "supervisor.h"
+
+#include <QSettings>
+#include <QSocketNotifier>
+
 #endif // of IS_CONSOLE_QT
 
 #include "consolelogger.h"
@@ -33,7 +38,10 @@
 
 // HTTP server
 #include "microhttpserver.h"
+#include "microhttpconnectionstore.h"
 #include "requestmapper.h"
+#include "localserver.h"
+#include "tilediskcache.h"
 
 // LIB OSM Scout interface
 #include "dbmaster.h"
@@ -46,8 +54,11 @@
 
 #include <QTranslator>
 #include <QDebug>
+#include <QFile>
 
+#include <algorithm>
 #include <iostream>
+#include <memory>
 
 // this is needed for connection with signals. Otherwise, access via static members
 extern InfoHub infoHub;
@@ -56,6 +67,33 @@ extern InfoHub infoHub;
 
 int main(int argc, char *argv[])
 {
+    // worker processes are forked before the application object is
+    // created, any databases are opened or threads are started. Tile
+    // cache on disk is shared by the workers and is cleared once, by the
+    // supervisor
+    bool primary_process = true;
+    int processes = 1;
+#ifdef IS_CONSOLE_QT
+    QCoreApplication::setApplicationName(APP_PREFIX "osmscout-server");
+    QCoreApplication::setOrganizationName(APP_PREFIX "osmscout-server");
+    {
+        QSettings startup_settings(APP_PREFIX "osmscout-server", APP_PREFIX "osmscout-server");
+        processes = std::max(1, startup_settings.value("http-listener/processes", 1).toInt());
+    }
+
+    if (processes > 1)
+    {
+        if (!TileDiskCache::remove(TileDiskCache::location()))
+            std::cerr << "Failed to clear tile cache on disk" << std::endl;
+
+        int status;
+        if (!Supervisor::run(processes, status))
+            return status;
+
+        primary_process = (Supervisor::worker() == 0);
+    }
+#endif
+
 #ifdef IS_CONSOLE_QT
 #ifdef USE_OSMSCOUT_MAP_CAIRO
     QScopedPointer<QCoreApplication> app(new QCoreApplication(argc,argv));
@@ -75,6 +113,21 @@ int main(int argc, char *argv[])
     app->setApplicationName(APP_PREFIX "osmscout-server");
     app->setOrganizationName(APP_PREFIX "osmscout-server");
 
+#ifdef IS_CONSOLE_QT
+    // SIGTERM and SIGINT stop the event loop. On exit, the list of hot
+    // tiles is saved and the sockets are removed
+    std::unique_ptr<QSocketNotifier> stop_notifier;
+    int stop_fd = Supervisor::watchStopSignals();
+    if (stop_fd >= 0)
+    {
+        stop_notifier.reset(new QSocketNotifier(stop_fd, QSocketNotifier::Read));
+        QObject::connect( stop_notifier.get(), &QSocketNotifier::activated,
+                          app.data(), &QCoreApplication::quit );
+    }
+    else
+        std::cerr << "Failed to setup handling of stop signals" << std::endl;
+#endif
+
     {
         QString tr_path;
 
@@ -151,10 +204,24 @@ int main(int argc, char *argv[])
     settings.beginGroup("http-listener");
     int port = settings.valueInt("port");
     QString host = settings.valueString("host");
+    MicroHTTP::ServerOptions http_options;
+    http_options.threads = std::max(0, settings.valueInt("threads"));
+    http_options.connection_limit = std::min( (unsigned int)std::max(1, settings.valueInt("connectionLimit")),
+                                              (unsigned int)MicroHTTP::ConnectionStore::capacity() );
+    http_options.connection_timeout = std::max(0, settings.valueInt("connectionTimeout"));
+    http_options.max_upload_size = std::max(0, settings.valueInt("maxUploadSize"));
+    http_options.reuse_port = ( settings.valueInt("reusePort") > 0 || processes > 1 );
+    QString http_socket = settings.valueString("socket");
+    bool permissions_ok = false;
+    unsigned int http_socket_permissions = settings.valueString("socketPermissions").toUInt(&permissions_ok, 8);
     settings.endGroup();
 
+    // local transport is destroyed after the request mapper has finished
+    // all tasks, they may still send their replies through it
+    std::unique_ptr<LocalServer> local_server;
+
     RequestMapper requests;
-    MicroHTTP::Server http_server( &requests, port, host.toStdString().c_str() );
+    MicroHTTP::Server http_server( &requests, port, host.toStdString().c_str(), http_options );
 
     if ( !http_server )
     {
@@ -162,6 +229,42 @@ int main(int argc, char *argv[])
         return -2;
     }
 
+    // optional HTTP server on Unix domain socket for clients on the same
+    // host. Socket can not be shared, only the first worker listens on it
+    std::unique_ptr<MicroHTTP::Server> http_socket_server;
+    if ( !http_socket.isEmpty() && primary_process )
+    {
+        if (!permissions_ok)
+        {
+            std::cerr << "Wrong socket permissions, using 0600" << std::endl;
+            http_socket_permissions = 0600;
+        }
+
+        http_socket_server.reset(new MicroHTTP::Server( &requests, QFile::encodeName(http_socket).constData(),
+                                                        http_socket_permissions, http_options ));
+        if ( !(*http_socket_server) )
+        {
+            std::cerr << "Failed to start HTTP server on socket " << http_socket.toStdString()
+                      << ", continuing without it" << std::endl;
+            http_socket_server.reset();
+        }
+    }
+
+    // setup local transport
+    settings.beginGroup("local-listener");
+    QString local_socket = settings.valueString("socket");
+    int local_slots = settings.valueInt("slots");
+    int local_slot_size = settings.valueInt("slotSize");
+    settings.endGroup();
+
+    local_server.reset(new LocalServer(&requests));
+    if ( !local_socket.isEmpty() && primary_process &&
+         !local_server->start(local_socket, local_slots, local_slot_size) )
+        std::cerr << "Failed to start local server, continuing without it" << std::endl;
+
+    // database is opened by now, fill tile cache in background
+    requests.warmupTiles();
+
 #ifdef IS_SAILFISH_OS
 
     v->setSource(SailfishApp::pathTo("qml/osmscout-server.qml"));
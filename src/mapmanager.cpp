@@ -3,6 +3,7 @@
 #include "appsettings.h"
 #include "config.h"
 #include "infohub.h"
+#include "metrics.h"
 
 #include <QDirIterator>
 #include <QDir>
@@ -30,6 +31,7 @@ using namespace MapManager;
 Manager::Manager(QObject *parent) : QObject(parent)
 {
   m_features.append(new FeatureOsmScout(this));
+  m_features.append(new FeatureOsmScoutOverview(this));
   m_features.append(new FeatureGeocoderNLP(this));
   m_features.append(new FeaturePostalGlobal(this));
   m_features.append(new FeaturePostalCountry(this));
@@ -826,6 +828,10 @@ bool Manager::startDownload(DownloadType type, const QString &url, const QString
   m_download_type = type;
   emit downloadingChanged(true);
 
+  Metrics::set(Metrics::Downloading, 1);
+  Metrics::set(Metrics::DownloadedBytes, 0);
+  Metrics::set(Metrics::WrittenBytes, 0);
+
   return true;
 }
 
@@ -923,6 +929,7 @@ void Manager::onDownloadError(QString err)
 
 void Manager::cleanupDownload()
 {
+  Metrics::set(Metrics::Downloading, 0);
   if (m_file_downloader)
     {
       m_file_downloader->disconnect();
@@ -971,12 +978,14 @@ void Manager::onDownloadProgress()
 void Manager::onDownloadedBytes(uint64_t sz)
 {
   m_last_reported_downloaded = sz;
+  Metrics::set(Metrics::DownloadedBytes, sz);
   onDownloadProgress();
 }
 
 void Manager::onWrittenBytes(uint64_t sz)
 {
   m_last_reported_written = sz;
+  Metrics::set(Metrics::WrittenBytes, sz);
   onDownloadProgress();
 }
 
@@ -1186,15 +1195,26 @@ void Manager::updateOsmScout()
 {
   AppSettings settings;
 
+  // database paths are set manually, as for testing
+  if (!settings.valueBool(MAPMANAGER_SETTINGS "manage_paths"))
+    return;
+
   QString path;
+  QString path_overview;
   QJsonObject obj = m_maps_available.value(m_map_selected).toObject();
   for (const Feature *f: m_features)
-    if (f->enabled() && f->name() == "osmscout")
-      path = fullPath( f->getPath(obj) );
+    {
+      if (f->enabled() && f->name() == "osmscout")
+        path = fullPath( f->getPath(obj) );
+      if (f->enabled() && f->name() == "osmscout_overview" && f->hasFeatureDefined(obj))
+        path_overview = fullPath( f->getPath(obj) );
+    }
 
-  if (settings.valueString(OSM_SETTINGS "map") != path)
+  if (settings.valueString(OSM_SETTINGS "map") != path ||
+      settings.valueString(OSM_SETTINGS "mapOverview") != path_overview)
     {
       settings.setValue(OSM_SETTINGS "map", path);
+      settings.setValue(OSM_SETTINGS "mapOverview", path_overview);
       emit databaseOsmScoutChanged(path);
     }
 }
@@ -1205,6 +1225,10 @@ void Manager::updateGeocoderNLP()
 {
   AppSettings settings;
 
+  // database paths are set manually, as for testing
+  if (!settings.valueBool(MAPMANAGER_SETTINGS "manage_paths"))
+    return;
+
   QString path;
 
   // version of the geocoder where all data is in a single file
@@ -1227,6 +1251,10 @@ void Manager::updatePostal()
 {
   AppSettings settings;
 
+  // database paths are set manually, as for testing
+  if (!settings.valueBool(MAPMANAGER_SETTINGS "manage_paths"))
+    return;
+
   QString path_global;
   QString path_country;
 
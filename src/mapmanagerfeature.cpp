@@ -90,6 +90,7 @@ bool Feature::isCompatible(const QJsonObject &request) const
 bool Feature::isAvailable(const QJsonObject &request) const
 {
   if (!m_enabled || !isMyType(request)) return true;
+  if (m_optional && !request.contains(m_name)) return true;
   if (!isCompatible(request)) return false;
 
   QString path = getPath(request);
@@ -117,6 +118,7 @@ void Feature::checkMissingFiles(const QJsonObject &request,
                                 FilesToDownload &missing) const
 {
   if (!m_enabled || !isMyType(request) || !isCompatible(request)) return;
+  if (m_optional && !request.contains(m_name)) return;
 
   QString path = getPath(request);
   QDir dir(m_path_provider->fullPath("."));
@@ -154,6 +156,7 @@ void Feature::fillWantedFiles(const QJsonObject &request,
                               QSet<QString> &wanted) const
 {
   if (!m_enabled || !isMyType(request)) return;
+  if (m_optional && !request.contains(m_name)) return;
 
   QString path = getPath(request);
   for (const auto &f: m_files)
@@ -163,6 +166,7 @@ void Feature::fillWantedFiles(const QJsonObject &request,
 void Feature::deleteFiles(const QJsonObject &request)
 {
   if (!m_enabled || !isMyType(request)) return;
+  if (m_optional && !request.contains(m_name)) return;
 
   QString path = getPath(request);
   QDir dir(m_path_provider->fullPath("."));
@@ -198,6 +202,36 @@ QString FeatureOsmScout::errorMissing() const
 }
 
 
+////////////////////////////////////////////////////////////
+/// libosmscout overview support
+///
+/// Generalized dataset used for rendering low zoom levels. Its optional
+/// and is downloaded together with libosmscout maps if provided
+const static QStringList osmscout_overview_files{
+  "areaarea.idx", "areanode.idx", "areas.dat", "areasopt.dat", "areaway.idx", "bounding.dat",
+  "nodes.dat", "water.idx", "ways.dat", "waysopt.dat", "types.dat"};
+
+FeatureOsmScoutOverview::FeatureOsmScoutOverview(PathProvider *path):
+  Feature(path, "territory", "osmscout_overview",
+          QCoreApplication::translate("MapManagerFeature", "OSM Scout library overview"),
+          osmscout_overview_files,
+          11)
+{
+  m_optional = true;
+}
+
+void FeatureOsmScoutOverview::loadSettings()
+{
+  AppSettings settings;
+  m_enabled = settings.valueBool(MAPMANAGER_SETTINGS "osmscout");
+}
+
+QString FeatureOsmScoutOverview::errorMissing() const
+{
+  return QCoreApplication::translate("MapManagerFeature", "Missing libosmscout overview maps");
+}
+
+
 ////////////////////////////////////////////////////////////
 /// Geocoder NLP support
 const static QStringList geocodernlp_files{
@@ -95,6 +95,7 @@ namespace MapManager {
     const int m_version;
 
     bool m_enabled{false};
+    bool m_optional{false}; ///< when true, the feature is not required if its missing in the request
     QString m_url;
 
     const QString const_feature_id_url{"url"};
@@ -112,6 +113,15 @@ namespace MapManager {
     virtual QString errorMissing() const;
   };
 
+  class FeatureOsmScoutOverview: public Feature
+  {
+  public:
+    FeatureOsmScoutOverview(PathProvider *path);
+    virtual ~FeatureOsmScoutOverview() {}
+    virtual void loadSettings();
+    virtual QString errorMissing() const;
+  };
+
   class FeatureGeocoderNLP: public Feature
   {
   public:
@@ -0,0 +1,172 @@
+#include "metrics.h"
+
+#include <array>
+#include <atomic>
+#include <cmath>
+
+// upper bounds of the latency histogram buckets, in seconds
+static const double latency_buckets[] = {
+    0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0
+};
+#define NUMBER_OF_BUCKETS (sizeof(latency_buckets)/sizeof(latency_buckets[0]))
+
+// status codes counted separately, the others are counted together as 0
+static const unsigned int status_codes[] = {
+    200, 400, 404, 405, 413, 500, 503, 504, 0
+};
+#define NUMBER_OF_CODES (sizeof(status_codes)/sizeof(status_codes[0]))
+
+namespace {
+
+struct EndpointStats
+{
+    std::array<std::atomic<quint64>, NUMBER_OF_CODES> status;
+    std::array<std::atomic<quint64>, NUMBER_OF_BUCKETS + 1> latency;
+    std::atomic<qint64> latency_nsecs{0};
+
+    EndpointStats()
+    {
+        for (auto &s: status) s = 0;
+        for (auto &l: latency) l = 0;
+    }
+};
+
+std::array<EndpointStats, Metrics::NumberOfEndpoints> endpoints;
+std::array<std::atomic<quint64>, Metrics::NumberOfCounters> counters;
+std::array<std::atomic<qint64>, Metrics::NumberOfGauges> gauges;
+
+}
+
+Metrics::Endpoint Metrics::endpoint(const QString &path)
+{
+    if (path == "/v1/tile") return EndpointTile;
+    if (path == "/v1/search" || path == "/v2/search") return EndpointSearch;
+    if (path == "/v1/guide") return EndpointGuide;
+    if (path == "/v1/poi_types") return EndpointPoiTypes;
+    if (path == "/v1/route") return EndpointRoute;
+    if (path == "/v1/batch") return EndpointBatch;
+    if (path.startsWith("/v1/stats/") || path == "/v1/trace" || path == "/v1/metrics") return EndpointStats;
+    return EndpointOther;
+}
+
+const char* Metrics::endpointName(int endpoint)
+{
+    switch (endpoint)
+    {
+    case EndpointTile: return "tile";
+    case EndpointSearch: return "search";
+    case EndpointGuide: return "guide";
+    case EndpointPoiTypes: return "poi_types";
+    case EndpointRoute: return "route";
+    case EndpointBatch: return "batch";
+    case EndpointStats: return "stats";
+    default: return "other";
+    }
+}
+
+void Metrics::addRequest(Endpoint endpoint, unsigned int status)
+{
+    size_t i = 0;
+    while (i < NUMBER_OF_CODES - 1 && status_codes[i] != status)
+        ++i;
+    endpoints[endpoint].status[i]++;
+}
+
+void Metrics::addLatency(Endpoint endpoint, qint64 nsecs)
+{
+    double secs = nsecs * 1e-9;
+    size_t i = 0;
+    while (i < NUMBER_OF_BUCKETS && secs > latency_buckets[i])
+        ++i;
+
+    EndpointStats &e = endpoints[endpoint];
+    e.latency[i]++;
+    e.latency_nsecs += nsecs;
+}
+
+void Metrics::increment(Counter counter)
+{
+    counters[counter]++;
+}
+
+void Metrics::set(Gauge gauge, qint64 value)
+{
+    gauges[gauge] = value;
+}
+
+void Metrics::writeHeader(QTextStream &output, const char *name, const char *type, const char *help)
+{
+    output << "# HELP " << name << " " << help << "\n"
+           << "# TYPE " << name << " " << type << "\n";
+}
+
+void Metrics::writeSample(QTextStream &output, const char *name, const QString &labels, double value)
+{
+    output << name;
+    if (!labels.isEmpty())
+        output << "{" << labels << "}";
+    output << " ";
+
+    if (std::isinf(value)) output << (value > 0 ? "+Inf" : "-Inf");
+    else output << QString::number(value, 'g', 15);
+    output << "\n";
+}
+
+void Metrics::write(QTextStream &output)
+{
+    writeHeader(output, "osmscout_requests_total", "counter",
+                "Number of HTTP requests by endpoint and status code");
+    for (int e=0; e < NumberOfEndpoints; ++e)
+        for (size_t i=0; i < NUMBER_OF_CODES; ++i)
+        {
+            quint64 n = endpoints[e].status[i];
+            if (n == 0) continue;
+            writeSample(output, "osmscout_requests_total",
+                        QString("endpoint=\"%1\",code=\"%2\"").arg(endpointName(e)).
+                        arg(status_codes[i] ? QString::number(status_codes[i]) : QString("other")),
+                        n);
+        }
+
+    writeHeader(output, "osmscout_request_duration_seconds", "histogram",
+                "Time from receiving the request until the response is ready");
+    for (int e=0; e < NumberOfEndpoints; ++e)
+    {
+        const EndpointStats &s = endpoints[e];
+        QString endpoint = QString("endpoint=\"%1\"").arg(endpointName(e));
+
+        quint64 count = 0;
+        for (size_t i=0; i <= NUMBER_OF_BUCKETS; ++i)
+        {
+            count += s.latency[i];
+            QString le = (i < NUMBER_OF_BUCKETS ? QString::number(latency_buckets[i]) : QString("+Inf"));
+            writeSample(output, "osmscout_request_duration_seconds_bucket",
+                        endpoint + ",le=\"" + le + "\"", count);
+        }
+
+        writeSample(output, "osmscout_request_duration_seconds_sum", endpoint, s.latency_nsecs * 1e-9);
+        writeSample(output, "osmscout_request_duration_seconds_count", endpoint, count);
+    }
+
+    writeHeader(output, "osmscout_request_timeouts_total", "counter",
+                "Number of HTTP requests answered with the timeout error");
+    writeSample(output, "osmscout_request_timeouts_total", QString(), counters[RequestTimeouts]);
+
+    writeHeader(output, "osmscout_database_opens_total", "counter",
+                "Number of times the map database was opened");
+    writeSample(output, "osmscout_database_opens_total", "result=\"ok\"", counters[DatabaseOpens]);
+    writeSample(output, "osmscout_database_opens_total", "result=\"error\"", counters[DatabaseOpenErrors]);
+
+    writeHeader(output, "osmscout_geocoder_opens_total", "counter",
+                "Number of times the geocoder database was opened");
+    writeSample(output, "osmscout_geocoder_opens_total", "result=\"ok\"", counters[GeocoderOpens]);
+    writeSample(output, "osmscout_geocoder_opens_total", "result=\"error\"", counters[GeocoderOpenErrors]);
+
+    writeHeader(output, "osmscout_download_active", "gauge",
+                "1 if map data is being downloaded");
+    writeSample(output, "osmscout_download_active", QString(), gauges[Downloading]);
+
+    writeHeader(output, "osmscout_download_bytes", "gauge",
+                "Bytes downloaded and written by the current download");
+    writeSample(output, "osmscout_download_bytes", "stage=\"downloaded\"", gauges[DownloadedBytes]);
+    writeSample(output, "osmscout_download_bytes", "stage=\"written\"", gauges[WrittenBytes]);
+}
@@ -0,0 +1,69 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QByteArray>
+#include <QString>
+#include <QTextStream>
+
+/// \brief Metrics of the server in Prometheus text exposition format
+///
+/// Keeps per-endpoint request counts by status code and latency
+/// histograms together with the counters and gauges updated by the
+/// other components, such as database opens and download progress.
+/// All updates are lock-free. Thread safe.
+class Metrics
+{
+public:
+    enum Endpoint {
+        EndpointTile = 0,
+        EndpointSearch,
+        EndpointGuide,
+        EndpointPoiTypes,
+        EndpointRoute,
+        EndpointBatch,
+        EndpointStats, ///< statistics, traces and metrics
+        EndpointOther,
+        NumberOfEndpoints
+    };
+
+    enum Counter {
+        DatabaseOpens = 0,
+        DatabaseOpenErrors,
+        GeocoderOpens,
+        GeocoderOpenErrors,
+        RequestTimeouts,
+        NumberOfCounters
+    };
+
+    enum Gauge {
+        Downloading = 0,
+        DownloadedBytes,
+        WrittenBytes,
+        NumberOfGauges
+    };
+
+public:
+    static Endpoint endpoint(const QString &path);
+
+    /// \brief Count the request answered with the given HTTP status
+    static void addRequest(Endpoint endpoint, unsigned int status);
+
+    /// \brief Record time from receiving the request until the response is ready
+    static void addLatency(Endpoint endpoint, qint64 nsecs);
+
+    static void increment(Counter counter);
+    static void set(Gauge gauge, qint64 value);
+
+    /// \brief Write the collected metrics
+    static void write(QTextStream &output);
+
+    /// \brief Write header of the metric family
+    static void writeHeader(QTextStream &output, const char *name, const char *type, const char *help);
+
+    /// \brief Write a single sample, labels are given as in Prometheus format without braces
+    static void writeSample(QTextStream &output, const char *name, const QString &labels, double value);
+
+    static const char* endpointName(int endpoint);
+};
+
+#endif // METRICS_H
@@ -0,0 +1,133 @@
+#include "renderprofiler.h"
+
+#include <QMutexLocker>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <algorithm>
+
+static const char* phase_names[RenderProfiler::NumberOfPhases] = {
+    "wait", "style", "lookupTiles", "loadData", "addData",
+    "groundTiles", "draw", "encode", "total"
+};
+
+RenderProfiler::RenderProfiler()
+{
+}
+
+const char* RenderProfiler::phaseName(int phase)
+{
+    if (phase < 0 || phase >= NumberOfPhases)
+        return "";
+    return phase_names[phase];
+}
+
+void RenderProfiler::record(int zoom, const Sample &sample)
+{
+    zoom = std::max(0, std::min(MaxZoom, zoom));
+
+    QMutexLocker lk(&m_mutex);
+    ZoomStats &z = m_zoom[zoom];
+
+    z.tiles++;
+    z.nodes += sample.nodes;
+    z.ways += sample.ways;
+    z.areas += sample.areas;
+    z.ground_tiles += sample.ground_tiles;
+    z.bytes += sample.bytes;
+
+    for (int p=0; p < NumberOfPhases; ++p)
+    {
+        PhaseStats &s = z.phases[p];
+        qint64 t = sample.nsecs[p];
+        s.count++;
+        s.total += t;
+        s.max = std::max(s.max, t);
+
+        int bucket = 0;
+        for (qint64 ms = t / 1000000; ms > 0 && bucket < NumberOfBuckets-1; ms >>= 1)
+            bucket++;
+        s.histogram[bucket]++;
+    }
+}
+
+void RenderProfiler::reset()
+{
+    QMutexLocker lk(&m_mutex);
+    m_zoom.fill(ZoomStats());
+}
+
+QByteArray RenderProfiler::toJson()
+{
+    QJsonObject root;
+
+    QJsonArray buckets;
+    for (int b=0; b < NumberOfBuckets-1; ++b)
+        buckets.append(1 << b);
+    root.insert("bucketsMs", buckets);
+
+    QJsonArray zooms;
+    {
+        QMutexLocker lk(&m_mutex);
+        for (int zoom=0; zoom <= MaxZoom; ++zoom)
+        {
+            const ZoomStats &z = m_zoom[zoom];
+            if (z.tiles == 0)
+                continue;
+
+            QJsonObject zo;
+            zo.insert("zoom", zoom);
+            zo.insert("tiles", (double)z.tiles);
+            zo.insert("nodes", (double)z.nodes / z.tiles);
+            zo.insert("ways", (double)z.ways / z.tiles);
+            zo.insert("areas", (double)z.areas / z.tiles);
+            zo.insert("groundTiles", (double)z.ground_tiles / z.tiles);
+            zo.insert("bytes", (double)z.bytes / z.tiles);
+
+            QJsonObject phases;
+            for (int p=0; p < NumberOfPhases; ++p)
+            {
+                const PhaseStats &s = z.phases[p];
+                QJsonObject po;
+                po.insert("meanMs", s.count > 0 ? s.total * 1e-6 / s.count : 0.0);
+                po.insert("maxMs", s.max * 1e-6);
+
+                QJsonArray histogram;
+                for (size_t h: s.histogram)
+                    histogram.append((double)h);
+                po.insert("histogram", histogram);
+
+                phases.insert(phaseName(p), po);
+            }
+            zo.insert("phases", phases);
+
+            zooms.append(zo);
+        }
+    }
+
+    root.insert("zoom", zooms);
+
+    return QJsonDocument(root).toJson();
+}
+
+QString RenderProfiler::summary()
+{
+    QString txt;
+
+    QMutexLocker lk(&m_mutex);
+    for (int zoom=0; zoom <= MaxZoom; ++zoom)
+    {
+        const ZoomStats &z = m_zoom[zoom];
+        if (z.tiles == 0)
+            continue;
+
+        txt += QString("z=%1 tiles=%2").arg(zoom).arg(z.tiles);
+        for (int p=0; p < NumberOfPhases; ++p)
+            txt += QString(" %1=%2ms").arg(phaseName(p)).
+                    arg(z.phases[p].total * 1e-6 / z.tiles, 0, 'f', 1);
+        txt += "\n";
+    }
+
+    return txt;
+}
@@ -0,0 +1,91 @@
+#ifndef RENDERPROFILER_H
+#define RENDERPROFILER_H
+
+#include <QByteArray>
+#include <QMutex>
+#include <QString>
+
+#include <array>
+#include <cstdint>
+
+/// \brief Collects timings of tile rendering phases
+///
+/// Timings of each rendering phase are aggregated into histograms,
+/// separately for each zoom level, together with the number of the
+/// drawn objects. This allows to find out whether slow tiles are limited
+/// by data loading, drawing or PNG encoding. Thread safe.
+class RenderProfiler
+{
+public:
+    enum Phase {
+        PhaseWait = 0,      ///< waiting for database lock
+        PhaseStyle,         ///< style check and loading
+        PhaseLookupTiles,
+        PhaseLoadData,      ///< LoadMissingTileData
+        PhaseAddData,       ///< AddTileDataToMapData
+        PhaseGroundTiles,
+        PhaseDraw,
+        PhaseEncode,
+        PhaseTotal,
+        NumberOfPhases
+    };
+
+    /// \brief Timings and object counts of a single rendered tile
+    struct Sample
+    {
+        std::array<qint64, NumberOfPhases> nsecs;
+        size_t nodes = 0;
+        size_t ways = 0;
+        size_t areas = 0;
+        size_t ground_tiles = 0;
+        size_t bytes = 0;
+
+        Sample() { nsecs.fill(0); }
+    };
+
+    static const int MaxZoom = 22;
+    static const int NumberOfBuckets = 14; ///< buckets are <1, <2, <4, ..., <4096 ms, and the rest
+
+public:
+    RenderProfiler();
+
+    void record(int zoom, const Sample &sample);
+
+    void reset();
+
+    /// \brief Statistics as JSON, zoom levels without rendered tiles are skipped
+    QByteArray toJson();
+
+    /// \brief Short human readable summary for the log
+    QString summary();
+
+    static const char* phaseName(int phase);
+
+protected:
+    struct PhaseStats
+    {
+        size_t count = 0;
+        qint64 total = 0;
+        qint64 max = 0;
+        std::array<size_t, NumberOfBuckets> histogram;
+
+        PhaseStats() { histogram.fill(0); }
+    };
+
+    struct ZoomStats
+    {
+        size_t tiles = 0;
+        size_t nodes = 0;
+        size_t ways = 0;
+        size_t areas = 0;
+        size_t ground_tiles = 0;
+        size_t bytes = 0;
+        std::array<PhaseStats, NumberOfPhases> phases;
+    };
+
+protected:
+    QMutex m_mutex;
+    std::array<ZoomStats, MaxZoom+1> m_zoom;
+};
+
+#endif // RENDERPROFILER_H
@@ -8,45 +8,165 @@
 #include "geomaster.h"
 #include "infohub.h"
 #include "config.h"
+#include "appsettings.h"
 
 #include "microhttpconnectionstore.h"
+#include "microhttpcompressor.h"
+#include "metrics.h"
+#include "tracer.h"
+#include "accesslog.h"
+
+#ifdef IS_CONSOLE_QT
+#include "supervisor.h"
+#endif
 
 #include <microhttpd.h>
 
 #include <QTextStream>
 #include <QUrl>
 #include <QRunnable>
+#include <QThread>
 #include <QThreadPool>
 #include <QDir>
+#include <QStandardPaths>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
 
 #include <QDebug>
 
+#include <algorithm>
 #include <functional>
+#include <memory>
+#include <vector>
 
 //#define DEBUG_CONNECTIONS
 
+// save keys of the hot tiles after rendering this number of tiles
+#define TILES_HOT_SAVE_EVERY 500
+
+// maximal width and height of the rendered metatile in pixels
+#define METATILE_MAX_SIZE 2048
+
+extern InfoHub infoHub;
+
 RequestMapper::RequestMapper()
 {
+    int cpus = QThread::idealThreadCount();
+
 #ifdef IS_SAILFISH_OS
     // In Sailfish, CPUs could be switched off one by one. As a result,
     // "ideal thread count" set by Qt could be off.
     // In other systems, this procedure is not needed and the defaults can be used
     //
-    int cpus = 0;
-    QDir dir;
-    while ( dir.exists(QString("/sys/devices/system/cpu/cpu") + QString::number(cpus)) )
+    cpus = 0;
+    QDir cpudir;
+    while ( cpudir.exists(QString("/sys/devices/system/cpu/cpu") + QString::number(cpus)) )
         ++cpus;
+#endif
+
+    AppSettings settings;
+
+    // each endpoint has its own pool of workers. This ensures that heavy
+    // requests, such as routing, cannot occupy all threads needed by the others
+    struct { QThreadPool *pool; const char *name; } pools[] = {
+        { &m_pool_tile, "tile" },
+        { &m_pool_search, "search" },
+        { &m_pool_guide, "guide" },
+        { &m_pool_route, "route" } };
+
+    for (auto p: pools)
+    {
+        int n = settings.valueInt(QString("workers/") + p.name);
+        p.pool->setMaxThreadCount(n > 0 ? n : std::max(1, cpus));
+        InfoHub::logInfo(QString("Number of parallel worker threads for %1: %2").
+                         arg(p.name).arg(p.pool->maxThreadCount()));
+    }
 
-    m_pool.setMaxThreadCount(cpus);
+    Tracer::setup(settings.valueInt("tracing/spans"));
+
+    m_compression_min_size = settings.valueInt("http-listener/compressionMinSize");
+    m_batch_max_operations = settings.valueInt("http-listener/batchMaxOperations");
+    m_tile_cache.setMaxSize(settings.valueInt(OSM_SETTINGS "tileCacheSize") * 1024);
+    m_tile_cache_hot_size = settings.valueInt(OSM_SETTINGS "tileCacheWarmup");
+    m_tile_cache_serve_stale = (settings.valueInt(OSM_SETTINGS "tileCacheServeStale") > 0);
+
+    // requests exceeding the number of running and queued tasks are rejected
+    m_queue_tile.setup(&m_pool_tile, settings.valueInt("admission/tileRunning"), settings.valueInt("admission/tileQueue"));
+    m_queue_search.setup(&m_pool_search, settings.valueInt("admission/searchRunning"), settings.valueInt("admission/searchQueue"));
+    m_queue_guide.setup(&m_pool_guide, settings.valueInt("admission/guideRunning"), settings.valueInt("admission/guideQueue"));
+    m_queue_route.setup(&m_pool_route, settings.valueInt("admission/routeRunning"), settings.valueInt("admission/routeQueue"));
+    m_retry_after = QByteArray::number( std::max(1, settings.valueInt("admission/retryAfter")) );
+
+    // requests waiting for the response longer than deadline are answered with timeout error
+    m_deadline_tile = std::max(0, settings.valueInt("deadlines/tile")) * 1000;
+    m_deadline_search = std::max(0, settings.valueInt("deadlines/search")) * 1000;
+    m_deadline_guide = std::max(0, settings.valueInt("deadlines/guide")) * 1000;
+    m_deadline_route = std::max(0, settings.valueInt("deadlines/route")) * 1000;
+    if (m_deadline_tile > 0 || m_deadline_search > 0 || m_deadline_guide > 0 || m_deadline_route > 0)
+        m_watchdog.start();
+
+    // metatile size is rounded down to the power of 2
+    int metatile = settings.valueInt(OSM_SETTINGS "renderMetaTiles");
+    m_metatile_size = 1;
+    while (m_metatile_size*2 <= metatile && m_metatile_size < 8)
+        m_metatile_size *= 2;
+
+    // in multi-process mode, the disk cache is shared and each worker
+    // process gets its part of the total size
+    int processes = 1;
+#ifdef IS_CONSOLE_QT
+    processes = std::max(1, settings.valueInt("http-listener/processes"));
+#endif
 
+    QString dirpath = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    QDir dir;
+    if (dir.mkpath(dirpath))
+    {
+        // list of hot tiles is shared by the worker processes, only the
+        // first one warms up the cache on disk and saves the list
+#ifdef IS_CONSOLE_QT
+        if (Supervisor::worker() == 0)
 #endif
+            m_tile_cache_hot_fname = dirpath + "/tiles_hot.txt";
+
+        QString tiles_dir = TileDiskCache::location();
+        if ( !m_tile_disk_cache.setup(tiles_dir,
+                                      settings.valueInt(OSM_SETTINGS "tileDiskCacheSize") * 1024 / processes,
+                                      processes > 1) )
+            InfoHub::logWarning("Failed to setup tile cache on disk: " + tiles_dir);
 
-    InfoHub::logInfo("Number of parallel worker threads: " + QString::number(m_pool.maxThreadCount()));
+        // each worker process writes its own log
+        if (settings.valueBool("access-log/enable"))
+        {
+            QString fname = dirpath + "/access.jsonl";
+#ifdef IS_CONSOLE_QT
+            if (processes > 1)
+                fname = dirpath + QString("/access-%1.jsonl").arg(Supervisor::worker());
+#endif
+            if ( !AccessLog::setup(fname, (qint64)settings.valueInt("access-log/maxSize") * 1024 * 1024) )
+                InfoHub::logWarning("Failed to open access log: " + fname);
+        }
+    }
 }
 
 
 RequestMapper::~RequestMapper()
 {
+    m_shutdown = true;
+    m_watchdog.stop();
+    m_queue_tile.clear();
+    m_queue_search.clear();
+    m_queue_guide.clear();
+    m_queue_route.clear();
+    for (QThreadPool *pool: {&m_pool_tile, &m_pool_search, &m_pool_guide, &m_pool_route})
+        pool->clear();
+    for (QThreadPool *pool: {&m_pool_tile, &m_pool_search, &m_pool_guide, &m_pool_route})
+        pool->waitForDone();
+    saveHotTiles();
+    AccessLog::close();
 }
 
 
@@ -64,12 +184,12 @@ RequestMapper::~RequestMapper()
 //    return (int)(floor((1.0 - log( tan(lat * M_PI/180.0) + 1.0 / cos(lat * M_PI/180.0)) / M_PI) / 2.0 * pow(2.0, z)));
 //}
 
-static double tilex2long(int x, int z)
+static double tilex2long(double x, int z)
 {
     return x / pow(2.0, z) * 360.0 - 180;
 }
 
-static double tiley2lat(int y, int z)
+static double tiley2lat(double y, int z)
 {
     double n = M_PI - 2.0 * M_PI * y / pow(2.0, z);
     return 180.0 / M_PI * atan(0.5 * (exp(n) - exp(-n)));
@@ -114,34 +234,38 @@ template <> QString qstring2value(const QString &s, bool &ok)
 }
 
 template <typename T>
-T q2value(const QString &key, T default_value, MHD_Connection *q, bool &ok)
+T q2value(const QString &key, T default_value, const RequestMapper::Arguments &args, bool &ok)
 {
-    const char *vstr = MHD_lookup_connection_value(q, MHD_GET_ARGUMENT_KIND, key.toStdString().c_str());
-    if (vstr == NULL)
+    RequestMapper::Arguments::const_iterator iter = args.constFind(key);
+    if (iter == args.constEnd())
         return default_value;
 
     bool this_ok = true;
-    T v = qstring2value<T>(vstr,this_ok);
+    T v = qstring2value<T>(iter.value(),this_ok);
     if (!this_ok)
         v = default_value;
     ok = (ok && this_ok);
     return v;
 }
 
-static bool has(const char *key, MHD_Connection *q)
+static bool has(const QString &key, const RequestMapper::Arguments &args)
 {
-    return ( MHD_lookup_connection_value(q, MHD_GET_ARGUMENT_KIND, key)!=nullptr );
+    return args.contains(key);
 }
 
-static bool has(const QString &key, MHD_Connection *q)
+static int collect_argument(void *cls, enum MHD_ValueKind /*kind*/, const char *key, const char *value)
 {
-    return has(key.toStdString().c_str(), q);
+    RequestMapper::Arguments *args = (RequestMapper::Arguments*)cls;
+    QString k = QString::fromUtf8(key);
+    if (!args->contains(k)) // the first value is used as in MHD_lookup_connection_value
+        args->insert(k, value == NULL ? QString() : QString::fromUtf8(value));
+    return MHD_YES;
 }
 
 //////////////////////////////////////////////////////////////////////
 /// Default error function
 //////////////////////////////////////////////////////////////////////
-static void errorText(MHD_Response *response, MicroHTTP::Connection::keytype connection_id, const char *txt)
+static void errorText(const RequestMapper::Reply &reply, QString &content_type, const char *txt)
 {
     InfoHub::logWarning(txt);
 
@@ -151,8 +275,17 @@ static void errorText(MHD_Response *response, MicroHTTP::Connection::keytype con
         output << txt;
     }
 
-    MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, "text/html; charset=UTF-8");
-    MicroHTTP::ConnectionStore::setData(connection_id, data, false);
+    content_type = "text/html; charset=UTF-8";
+    reply(data, false);
+}
+
+// Reply used when the request is rejected by admission control. Not
+// logged as it would flood the log under overload
+static void overloaded(const RequestMapper::Reply &reply, QString &content_type)
+{
+    QByteArray data("Server is overloaded, try again later");
+    content_type = "text/html; charset=UTF-8";
+    reply(data, false);
 }
 
 static void makeEmptyJson(QByteArray &result)
@@ -166,6 +299,16 @@ void RequestMapper::loguri(const char *uri)
     InfoHub::logInfo("Request: " + QString(uri));
 }
 
+uint64_t RequestMapper::requestStarted(const char *url)
+{
+    return Tracer::begin(url);
+}
+
+void RequestMapper::requestCompleted(uint64_t id, bool ok)
+{
+    Tracer::end(id, ok);
+}
+
 /////////////////////////////////////////////////////////////////////////////
 /// Runnable classes used to solve the tasks
 /////////////////////////////////////////////////////////////////////////////
@@ -173,16 +316,19 @@ void RequestMapper::loguri(const char *uri)
 class Task: public QRunnable
 {
 public:
-    Task(MicroHTTP::Connection::keytype key,
+    Task(const RequestMapper::Reply &reply,
          std::function<bool(QByteArray &)> caller,
          QString error_message):
         QRunnable(),
-        m_key(key),
+        m_reply(reply),
         m_caller(caller),
-        m_error_message(error_message)
+        m_error_message(error_message),
+        m_trace(Tracer::current()),
+        m_queued(Tracer::now()),
+        m_breaker(Watchdog::current())
     {
 #ifdef DEBUG_CONNECTIONS
-        InfoHub::logInfo("Runnable created: " + QString::number((size_t)m_key));
+        InfoHub::logInfo("Runnable created: " + QString::number((size_t)this));
 #endif
         InfoHub::addJobToQueue();
     }
@@ -190,7 +336,7 @@ public:
     virtual ~Task()
     {
 #ifdef DEBUG_CONNECTIONS
-        InfoHub::logInfo("Runnable destroyed: " + QString::number((size_t)m_key));
+        InfoHub::logInfo("Runnable destroyed: " + QString::number((size_t)this));
 #endif
         InfoHub::removeJobFromQueue();
     }
@@ -198,77 +344,800 @@ public:
     virtual void run()
     {
 #ifdef DEBUG_CONNECTIONS
-        InfoHub::logInfo("Runnable running: " + QString::number((size_t)m_key));
+        InfoHub::logInfo("Runnable running: " + QString::number((size_t)this));
 #endif
 
+        Tracer::Scope scope(m_trace);
+        Tracer::record(m_trace, "queue", m_queued, Tracer::now(), true);
+        Tracer::Span span("compute");
+        Watchdog::Scope watchdog(m_breaker);
+
+        // request has timed out while waiting in the queue
         QByteArray data;
-        if ( !m_caller(data) )
+        if ( Watchdog::expired() || !m_caller(data) )
         {
             QByteArray err;
             {
                 QTextStream output(&err, QIODevice::WriteOnly);
-                output << m_error_message;
+                output << (Watchdog::expired() ? QString("Request timed out") : m_error_message);
             }
 
 #ifdef DEBUG_CONNECTIONS
-            InfoHub::logInfo("Runnable submitting error: " + QString::number((size_t)m_key));
+            InfoHub::logInfo("Runnable submitting error: " + QString::number((size_t)this));
 #endif
-            MicroHTTP::ConnectionStore::setData(m_key, err, false);
+            m_reply(err, true);
             return;
         }
 
 #ifdef DEBUG_CONNECTIONS
-        InfoHub::logInfo("Runnable submitting data: " + QString::number((size_t)m_key));
+        InfoHub::logInfo("Runnable submitting data: " + QString::number((size_t)this));
 #endif
-        MicroHTTP::ConnectionStore::setData(m_key, data, false);
+        m_reply(data, false);
     }
 
 protected:
-    MicroHTTP::Connection::keytype m_key;
+    RequestMapper::Reply m_reply;
     std::function<bool(QByteArray &)> m_caller;
     QString m_error_message;
+    quint64 m_trace;
+    qint64 m_queued;
+    osmscout::BreakerRef m_breaker;
+};
+
+class StreamTask: public QRunnable
+{
+public:
+    StreamTask(const RequestMapper::StreamReply &reply,
+               std::function<bool(QByteArray &, const DBMaster::OutputSink &)> caller,
+               QString error_message):
+        QRunnable(),
+        m_reply(reply),
+        m_caller(caller),
+        m_error_message(error_message),
+        m_trace(Tracer::current()),
+        m_queued(Tracer::now()),
+        m_breaker(Watchdog::current())
+    {
+        InfoHub::addJobToQueue();
+    }
+
+    virtual ~StreamTask()
+    {
+        InfoHub::removeJobFromQueue();
+    }
+
+    virtual void run()
+    {
+        Tracer::Scope scope(m_trace);
+        Tracer::record(m_trace, "queue", m_queued, Tracer::now(), true);
+        Tracer::Span span("compute");
+        Watchdog::Scope watchdog(m_breaker);
+
+        // request has timed out while waiting in the queue
+        if (Watchdog::expired())
+        {
+            QByteArray err("Request timed out");
+            m_reply(err, true, true);
+            return;
+        }
+
+        bool started = false;
+        DBMaster::OutputSink sink = [this, &started](const QByteArray &chunk) {
+            if (!chunk.isEmpty()) started = true;
+            return m_reply(chunk, false, false);
+        };
+
+        QByteArray data;
+        if ( m_caller(data, sink) )
+        {
+            m_reply(data, true, false);
+            return;
+        }
+
+        // error message is sent only if nothing has been sent yet,
+        // otherwise the response is aborted by the reply
+        QByteArray err;
+        if (!started)
+        {
+            QTextStream output(&err, QIODevice::WriteOnly);
+            output << m_error_message;
+        }
+        m_reply(err, true, true);
+    }
+
+protected:
+    RequestMapper::StreamReply m_reply;
+    std::function<bool(QByteArray &, const DBMaster::OutputSink &)> m_caller;
+    QString m_error_message;
+    quint64 m_trace;
+    qint64 m_queued;
+    osmscout::BreakerRef m_breaker;
+};
+
+class BackgroundTask: public QRunnable
+{
+public:
+    BackgroundTask(std::function<void()> caller):
+        QRunnable(),
+        m_caller(caller)
+    {
+    }
+
+    virtual void run()
+    {
+        m_caller();
+    }
+
+protected:
+    std::function<void()> m_caller;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+/// Tiles rendering and caching
+/////////////////////////////////////////////////////////////////////////////
+
+// tile coordinates have to be within the zoom level
+static bool tile_valid(const TileCache::Key &key)
+{
+    return key.z >= 0 && key.z <= TileStats::MaxZoom &&
+            key.x >= 0 && key.x < (1 << key.z) &&
+            key.y >= 0 && key.y < (1 << key.z);
+}
+
+bool RequestMapper::renderTile(const TileCache::Key &key, QByteArray &result)
+{
+    // keys are checked on request, tiles loaded from the list of hot tiles are not
+    if (!tile_valid(key))
+        return false;
+
+    // generation and identity are recorded before rendering to ensure that
+    // the tile is considered outdated if settings are changed while rendering
+    int generation = osmScoutMaster->renderGeneration();
+    QString identity = osmScoutMaster->renderIdentity();
+    int ntiles = 1 << key.shift;
+
+    // metatile is limited by the number of tiles at the zoom level and by its size in pixels
+    int meta = std::min(m_metatile_size, 1 << key.z);
+    while (meta > 1 && 256*key.scale*meta > METATILE_MAX_SIZE)
+        meta /= 2;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    if (meta <= 1)
+    {
+        if ( !osmScoutMaster->renderMap(key.daylight, 96*key.scale/ntiles, key.z + key.shift,
+                                        256*key.scale, 256*key.scale,
+                                        (tiley2lat(key.y, key.z) + tiley2lat(key.y+1, key.z))/2.0,
+                                        (tilex2long(key.x, key.z) + tilex2long(key.x+1, key.z))/2.0,
+                                        result) )
+            return false;
+
+        m_tile_cache.insert(key, generation, result);
+        if (identity == osmScoutMaster->renderIdentity())
+            m_tile_disk_cache.insert(key, identity, result);
+    }
+    else
+    {
+        TileCache::Key meta_key = key;
+        meta_key.x -= key.x % meta;
+        meta_key.y -= key.y % meta;
+
+        // wait if the metatile is rendered already by another thread
+        {
+            Tracer::Span span("metatile wait");
+            QMutexLocker lk(&m_metatile_mutex);
+            while (m_metatiles_rendering.contains(meta_key))
+                m_metatile_rendered.wait(&m_metatile_mutex);
+
+            if (m_tile_cache.get(key, generation, result))
+                return true;
+
+            m_metatiles_rendering.insert(meta_key);
+        }
+
+        // labels are placed once for the whole metatile and are
+        // consistent across the borders of the tiles cut from it
+        std::vector<QByteArray> results;
+        bool ok = osmScoutMaster->renderMap(key.daylight, 96*key.scale/ntiles, key.z + key.shift,
+                                            256*key.scale*meta, 256*key.scale*meta,
+                                            tiley2lat(meta_key.y + meta/2.0, key.z),
+                                            tilex2long(meta_key.x + meta/2.0, key.z),
+                                            meta, results);
+
+        // tiles on disk can be used by other processes and are stored only
+        // if they were rendered with the settings matching the identity
+        bool store_disk = ( identity == osmScoutMaster->renderIdentity() );
+        if (ok)
+            for (int j=0; j < meta; ++j)
+                for (int i=0; i < meta; ++i)
+                {
+                    TileCache::Key k = meta_key;
+                    k.x += i;
+                    k.y += j;
+
+                    const QByteArray &data = results[j*meta + i];
+                    m_tile_cache.insert(k, generation, data, k == key);
+                    if (store_disk)
+                        m_tile_disk_cache.insert(k, identity, data);
+                    if (k == key)
+                        result = data;
+                }
+
+        {
+            QMutexLocker lk(&m_metatile_mutex);
+            m_metatiles_rendering.remove(meta_key);
+            m_metatile_rendered.wakeAll();
+        }
+
+        if (!ok)
+            return false;
+    }
+
+    m_tile_stats.addRender(key, timer.nsecsElapsed() * 1e-6);
+
+    if ( (++m_tiles_rendered) % TILES_HOT_SAVE_EVERY == 0 )
+        saveHotTiles();
+
+    return true;
+}
+
+void RequestMapper::saveHotTiles()
+{
+    if ( m_tile_cache_hot_fname.isEmpty() || m_tile_cache_hot_size <= 0 )
+        return;
+
+    if ( !m_tile_cache.saveHotKeys(m_tile_cache_hot_fname, m_tile_cache_hot_size) )
+        InfoHub::logWarning("Failed to save the list of frequently requested tiles: " + m_tile_cache_hot_fname);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// Metrics
+/////////////////////////////////////////////////////////////////////////////
+
+void RequestMapper::writeMetrics(QByteArray &result)
+{
+    QTextStream output(&result, QIODevice::WriteOnly);
+
+    Metrics::write(output);
+
+    struct { EndpointQueue *queue; QThreadPool *pool; const char *name; } endpoints[] = {
+        { &m_queue_tile, &m_pool_tile, "tile" },
+        { &m_queue_search, &m_pool_search, "search" },
+        { &m_queue_guide, &m_pool_guide, "guide" },
+        { &m_queue_route, &m_pool_route, "route" } };
+
+    Metrics::writeHeader(output, "osmscout_queue_requests", "gauge",
+                         "Requests admitted for processing by endpoint and state");
+    for (auto e: endpoints)
+    {
+        Metrics::writeSample(output, "osmscout_queue_requests",
+                             QString("endpoint=\"%1\",state=\"running\"").arg(e.name), e.queue->running());
+        Metrics::writeSample(output, "osmscout_queue_requests",
+                             QString("endpoint=\"%1\",state=\"waiting\"").arg(e.name), e.queue->queued());
+    }
+
+    Metrics::writeHeader(output, "osmscout_jobs", "gauge",
+                         "Jobs running and waiting in all worker pools");
+    Metrics::writeSample(output, "osmscout_jobs", QString(), infoHub.queue());
+
+    Metrics::writeHeader(output, "osmscout_worker_threads", "gauge",
+                         "Worker threads by endpoint");
+    for (auto e: endpoints)
+    {
+        Metrics::writeSample(output, "osmscout_worker_threads",
+                             QString("endpoint=\"%1\",state=\"active\"").arg(e.name), e.pool->activeThreadCount());
+        Metrics::writeSample(output, "osmscout_worker_threads",
+                             QString("endpoint=\"%1\",state=\"max\"").arg(e.name), e.pool->maxThreadCount());
+    }
+
+    size_t active, suspended;
+    MicroHTTP::ConnectionStore::count(active, suspended);
+    Metrics::writeHeader(output, "osmscout_http_connections", "gauge",
+                         "HTTP connections being served, suspended ones are waiting for the response");
+    Metrics::writeSample(output, "osmscout_http_connections", "state=\"active\"", active);
+    Metrics::writeSample(output, "osmscout_http_connections", "state=\"suspended\"", suspended);
+    Metrics::writeSample(output, "osmscout_http_connections", "state=\"capacity\"",
+                         MicroHTTP::ConnectionStore::capacity());
+
+    // counters are restarted when tile statistics is reset
+    size_t requests, hits, stale, renders;
+    double render_msecs;
+    m_tile_stats.totals(requests, hits, stale, renders, render_msecs);
+
+    Metrics::writeHeader(output, "osmscout_tile_requests_total", "counter",
+                         "Tile requests by the result of the cache lookup");
+    Metrics::writeSample(output, "osmscout_tile_requests_total", "result=\"hit\"", hits);
+    Metrics::writeSample(output, "osmscout_tile_requests_total", "result=\"stale\"", stale);
+    Metrics::writeSample(output, "osmscout_tile_requests_total", "result=\"miss\"", requests - hits - stale);
+
+    Metrics::writeHeader(output, "osmscout_tile_renders_total", "counter", "Rendered tiles");
+    Metrics::writeSample(output, "osmscout_tile_renders_total", QString(), renders);
+
+    Metrics::writeHeader(output, "osmscout_tile_render_seconds_total", "counter", "Time spent rendering tiles");
+    Metrics::writeSample(output, "osmscout_tile_render_seconds_total", QString(), render_msecs * 1e-3);
+
+    Metrics::writeHeader(output, "osmscout_render_generation", "gauge",
+                         "Generation of the rendering settings, increased on database or style change");
+    Metrics::writeSample(output, "osmscout_render_generation", QString(), osmScoutMaster->renderGeneration());
+
+    output.flush();
+}
+
+int RequestMapper::deadline(const QString &path) const
+{
+    switch (Metrics::endpoint(path))
+    {
+    case Metrics::EndpointTile: return m_deadline_tile;
+    case Metrics::EndpointSearch: return m_deadline_search;
+    case Metrics::EndpointGuide: return m_deadline_guide;
+    case Metrics::EndpointRoute: return m_deadline_route;
+    default: return 0;
+    }
+}
+
+void RequestMapper::warmupTiles()
+{
+    if ( m_tile_cache_hot_fname.isEmpty() || m_tile_cache_hot_size <= 0 )
+        return;
+
+    QList<TileCache::Key> keys = TileCache::loadHotKeys(m_tile_cache_hot_fname);
+    if (keys.isEmpty())
+        return;
+
+    InfoHub::logInfo("Rendering frequently requested tiles in background: " + QString::number(keys.size()));
+
+    // low priority ensures that requests by clients are served first
+    m_pool_tile.start(new BackgroundTask(std::bind(&RequestMapper::renderHotTiles, this, keys)), -1);
+}
+
+void RequestMapper::renderHotTiles(const QList<TileCache::Key> &keys)
+{
+    int generation = osmScoutMaster->renderGeneration();
+    for (const TileCache::Key &key: keys)
+    {
+        if (m_shutdown || generation != osmScoutMaster->renderGeneration())
+            return;
+
+        if (m_tile_cache.contains(key, generation))
+            continue;
+
+        QByteArray data;
+        if (!renderTile(key, data))
+            return; // database is probably not available, no need to continue
+    }
+}
+
+void RequestMapper::refreshStaleTiles(int generation)
+{
+    // only one refresh job is started for each generation
+    int current = m_tiles_refresh_generation;
+    if ( current == generation ||
+         !m_tiles_refresh_generation.compare_exchange_strong(current, generation) )
+        return;
+
+    // low priority ensures that requests by clients are served first
+    m_pool_tile.start(new BackgroundTask(std::bind(&RequestMapper::renderStaleTiles, this, generation)), -1);
+}
+
+void RequestMapper::renderStaleTiles(int generation)
+{
+    QList<TileCache::Key> keys = m_tile_cache.staleKeys(generation);
+    if (keys.isEmpty())
+        return;
+
+    InfoHub::logInfo("Rendering outdated tiles in background: " + QString::number(keys.size()));
+
+    for (const TileCache::Key &key: keys)
+    {
+        // new job is started if generation changes again
+        if (m_shutdown || generation != osmScoutMaster->renderGeneration())
+            return;
+
+        // could be rendered already as a part of metatile or by request
+        if (m_tile_cache.contains(key, generation))
+            continue;
+
+        QByteArray data;
+        if (!renderTile(key, data))
+            return;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// Compression of the responses
+/////////////////////////////////////////////////////////////////////////////
+
+// Whether the response is compressed is decided either by the reply,
+// if the data is submitted before the headers are sent, or by the
+// service function. In the latter case, the data is always compressed
+enum CompressionDecision { CompressionUndecided, CompressionYes, CompressionNo };
+
+struct ReplyCompression
+{
+    MicroHTTP::Compressor::Encoding encoding;
+    std::atomic<int> decision{CompressionUndecided};
+    std::unique_ptr<MicroHTTP::Compressor> stream; ///< used by streamed responses
+};
+
+// Tiles are in compressed format already
+static bool compressible(const QString &path)
+{
+    return path != "/v1/tile";
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// Status and latency of the requests
+/////////////////////////////////////////////////////////////////////////////
+
+// Request is recorded in metrics and access log once both the status
+// returned by dispatch and the response are known. Failed responses are
+// recorded with the internal error status. For the requests with a
+// deadline, the response is known when the watch of the deadline is
+// stopped: by the reply, by the service function if the reply came
+// before the watch started, or by the watchdog answering with the
+// timeout error
+struct ReplyRecord
+{
+    Metrics::Endpoint endpoint;
+    QElapsedTimer timer;
+    std::shared_ptr<AccessLog::Entry> log_entry;
+
+    Watchdog *watchdog = nullptr; ///< set for the requests with a deadline
+    quint64 serial = 0;
+
+    std::atomic<int> pending{2};
+    unsigned int status = 0;        ///< returned by dispatch
+    unsigned int final_status = 0;  ///< replaces status of the failed or timed out request
+    qint64 nsecs = 0;
+    std::atomic<bool> failed{false};
+
+    // used by the single thread submitting the response
+    bool started = false;
+    bool owned = false;
+    bool streamed = false;
+
+    void dispatched(unsigned int s)
+    {
+        status = s;
+        complete();
+    }
+
+    // called once, with 0 if the response was not replaced
+    void responded(unsigned int replaced_status)
+    {
+        nsecs = timer.nsecsElapsed();
+        final_status = replaced_status;
+        complete();
+    }
+
+    unsigned int responseStatus() const
+    {
+        return failed ? MHD_HTTP_INTERNAL_SERVER_ERROR : 0;
+    }
+
+    // called after submitting the response or its chunk
+    void submitted(bool complete)
+    {
+        if (watchdog && !started)
+        {
+            started = true;
+            owned = watchdog->cancel(serial);
+        }
+        if (complete && (!watchdog || owned))
+            responded(responseStatus());
+    }
+
+protected:
+    void complete()
+    {
+        if (pending.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            return;
+
+        unsigned int s = ( final_status != 0 ? final_status : status );
+        Metrics::addRequest(endpoint, s);
+        Metrics::addLatency(endpoint, nsecs);
+        AccessLog::status(log_entry, s);
+        AccessLog::ready(log_entry, nsecs);
+    }
 };
 
 /////////////////////////////////////////////////////////////////////////////
-/// Request mapper main service function
+/// Request mapper service function called by HTTP server
 /////////////////////////////////////////////////////////////////////////////
 unsigned int RequestMapper::service(const char *url_c,
                                     MHD_Connection *connection, MHD_Response *response,
                                     MicroHTTP::Connection::keytype connection_id)
 {
+    return serve(url_c, nullptr, connection, response, connection_id);
+}
+
+unsigned int RequestMapper::servicePost(const char *url_c, const QByteArray &body,
+                                        MHD_Connection *connection, MHD_Response *response,
+                                        MicroHTTP::Connection::keytype connection_id)
+{
+    return serve(url_c, &body, connection, response, connection_id);
+}
+
+unsigned int RequestMapper::serve(const char *url_c, const QByteArray *body,
+                                  MHD_Connection *connection, MHD_Response *response,
+                                  MicroHTTP::Connection::keytype connection_id)
+{
+    // trace is made current by requestStarted
+    quint64 trace = Tracer::current();
+    Tracer::Span span("dispatch");
+
     QUrl url(url_c);
-    QString path(url.path());
+    Arguments args;
+    MHD_get_connection_values(connection, MHD_GET_ARGUMENT_KIND, collect_argument, &args);
+
+    Metrics::Endpoint endpoint = Metrics::endpoint(url.path());
+    QElapsedTimer timer;
+    timer.start();
+
+    std::shared_ptr<AccessLog::Entry> log_entry =
+            AccessLog::begin(body == nullptr ? "GET" : "POST", url.path(), args, body);
+
+    // tasks started for the request carry its breaker, used to abort
+    // them when the deadline has passed
+    int deadline_msecs = deadline(url.path());
+    qint64 started = Watchdog::now();
+    osmscout::BreakerRef breaker;
+    if (deadline_msecs > 0)
+        breaker = std::make_shared<osmscout::ThreadedBreaker>();
+    Watchdog::Scope watchdog_scope(breaker);
+
+    // watch of the deadline is cancelled when the response is submitted
+    std::shared_ptr<ReplyRecord> record = std::make_shared<ReplyRecord>();
+    record->endpoint = endpoint;
+    record->timer = timer;
+    record->log_entry = log_entry;
+    if (breaker)
+    {
+        record->watchdog = &m_watchdog;
+        record->serial = MicroHTTP::ConnectionStore::serial(connection_id);
+    }
+
+    std::shared_ptr<ReplyCompression> compression;
+    if (m_compression_min_size >= 0 && compressible(url.path()))
+    {
+        MicroHTTP::Compressor::Encoding encoding = MicroHTTP::Compressor::fromAcceptEncoding(
+                    MHD_lookup_connection_value(connection, MHD_HEADER_KIND, MHD_HTTP_HEADER_ACCEPT_ENCODING) );
+        if (encoding != MicroHTTP::Compressor::Identity)
+        {
+            compression = std::make_shared<ReplyCompression>();
+            compression->encoding = encoding;
+        }
+    }
+
+    int min_size = m_compression_min_size;
+    Reply reply = [connection_id, compression, min_size, trace, record](QByteArray &data, bool error) {
+        Tracer::ready(trace);
+        QByteArray compressed;
+        QByteArray *out = &data;
+        if (compression)
+        {
+            int decision = CompressionUndecided;
+            compression->decision.compare_exchange_strong(decision,
+                                                          data.size() >= min_size ? CompressionYes : CompressionNo);
+
+            // runs in the worker thread for the responses that are not ready immediately
+            if (compression->decision == CompressionYes &&
+                    !MicroHTTP::Compressor::compress(compression->encoding, data, compressed))
+            {
+                InfoHub::logWarning("Error while compressing response");
+                compressed.clear();
+                error = true;
+            }
+
+            if (compression->decision == CompressionYes)
+                out = &compressed;
+        }
+
+        // failure is marked before submitting, the watchdog finding the
+        // response submitted records it as well
+        if (error) record->failed = true;
+        MicroHTTP::ConnectionStore::setData(connection_id, *out, error);
+        record->submitted(true);
+    };
+
+    FileReply file_reply = [connection_id, trace, record](int fd, size_t size) {
+        Tracer::ready(trace);
+        MicroHTTP::ConnectionStore::setFile(connection_id, fd, size);
+        record->submitted(true);
+    };
+
+    // streamed responses are always compressed, their size is not known
+    // in advance. Chunks are submitted by a single worker thread
+    StreamReply stream_reply = [connection_id, compression, trace, record](const QByteArray &data, bool finish, bool error) {
+        if (finish)
+            Tracer::ready(trace);
+
+        // response of the request that failed before streaming anything
+        // is sent as usual, otherwise it is aborted
+        bool abort = ( error && record->streamed );
+        if (!data.isEmpty()) record->streamed = true;
+        if (error) record->failed = true;
+
+        QByteArray compressed;
+        const QByteArray *chunk = &data;
+        if (compression)
+        {
+            int decision = CompressionUndecided;
+            compression->decision.compare_exchange_strong(decision, CompressionYes);
+            if (!compression->stream)
+                compression->stream.reset(new MicroHTTP::Compressor(compression->encoding));
+
+            bool ok = compression->stream->add(data.constData(), data.size(), compressed);
+            if (finish && ok)
+                ok = compression->stream->finish(compressed);
+            if (!ok)
+            {
+                InfoHub::logWarning("Error while compressing response");
+                record->failed = true;
+                MicroHTTP::ConnectionStore::finish(connection_id, true);
+                return false;
+            }
+
+            chunk = &compressed;
+        }
+
+        bool ok = chunk->isEmpty() || MicroHTTP::ConnectionStore::append(connection_id, *chunk);
+        if (finish)
+            MicroHTTP::ConnectionStore::finish(connection_id, abort);
+        if (finish || !chunk->isEmpty())
+            record->submitted(finish);
+        return ok;
+    };
+
+    QString content_type;
+    unsigned int status;
+    if (body == nullptr)
+        status = dispatch(url.path(), args, reply, content_type, file_reply, stream_reply);
+    else if (url.path() == "/v1/batch")
+        status = batch(*body, reply, content_type);
+    else
+    {
+        errorText(reply, content_type, "Unknown URL path for POST request");
+        status = MHD_HTTP_BAD_REQUEST;
+    }
+
+    // deadline applies to the requests waiting for the response. If the
+    // response was submitted before the watch started, the watch is
+    // cancelled and the response is recorded here
+    MicroHTTP::Server *server;
+    MHD_Connection *mhd_connection;
+    if (breaker &&
+            MicroHTTP::ConnectionStore::state(connection_id, server, mhd_connection) ==
+            MicroHTTP::Connection::Wait )
+    {
+        Watchdog::Expire expire = [connection_id, record]() {
+            bool expired = MicroHTTP::ConnectionStore::expire(connection_id, record->serial);
+            record->responded(expired ? MHD_HTTP_GATEWAY_TIMEOUT : record->responseStatus());
+            return expired;
+        };
+        if ( !m_watchdog.watch(record->serial, started + deadline_msecs, expire, breaker) ||
+             ( MicroHTTP::ConnectionStore::state(connection_id, server, mhd_connection) !=
+               MicroHTTP::Connection::Wait &&
+               m_watchdog.cancel(record->serial) ) )
+            record->responded(record->responseStatus());
+    }
+    else if (breaker)
+        record->responded(record->responseStatus());
+
+    record->dispatched(status);
+
+    if (!content_type.isEmpty())
+        MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, content_type.toUtf8().constData());
 
+    if (status == MHD_HTTP_SERVICE_UNAVAILABLE)
+        MHD_add_response_header(response, MHD_HTTP_HEADER_RETRY_AFTER, m_retry_after.constData());
+
+    if (compression)
+    {
+        // response is not ready yet, it will be compressed when submitted
+        int decision = CompressionUndecided;
+        compression->decision.compare_exchange_strong(decision, CompressionYes);
+
+        if (compression->decision == CompressionYes)
+            MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_ENCODING,
+                                    MicroHTTP::Compressor::name(compression->encoding));
+        MHD_add_response_header(response, MHD_HTTP_HEADER_VARY, MHD_HTTP_HEADER_ACCEPT_ENCODING);
+    }
+
+    return status;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// Request mapper main dispatch function
+/////////////////////////////////////////////////////////////////////////////
+unsigned int RequestMapper::dispatch(const QString &path, const Arguments &args,
+                                     const Reply &reply, QString &content_type,
+                                     const FileReply &file_reply,
+                                     const StreamReply &stream_reply)
+{
     //////////////////////////////////////////////////////////////////////
     /// TILES
     if (path == "/v1/tile")
     {
         bool ok = true;
-        bool daylight = q2value<bool>("daylight", true, connection, ok);
-        int shift = q2value<int>("shift", 0, connection, ok);
-        int scale = q2value<int>("scale", 1, connection, ok);
-        int x = q2value<int>("x", 0, connection, ok);
-        int y = q2value<int>("y", 0, connection, ok);
-        int z = q2value<int>("z", 0, connection, ok);
+        bool daylight = q2value<bool>("daylight", true, args, ok);
+        int shift = q2value<int>("shift", 0, args, ok);
+        int scale = q2value<int>("scale", 1, args, ok);
+        int x = q2value<int>("x", 0, args, ok);
+        int y = q2value<int>("y", 0, args, ok);
+        int z = q2value<int>("z", 0, args, ok);
 
         if (!ok)
         {
-            errorText(response, connection_id, "Error while reading tile query parameters");
+            errorText(reply, content_type, "Error while reading tile query parameters");
+            return MHD_HTTP_BAD_REQUEST;
+        }
+
+        TileCache::Key key{daylight, shift, scale, x, y, z};
+        if (!tile_valid(key))
+        {
+            errorText(reply, content_type, "Tile coordinates are outside the zoom level");
             return MHD_HTTP_BAD_REQUEST;
         }
 
-        int ntiles = 1 << shift;
+        content_type = "image/png";
+
+        // outdated tiles are served while they are rendered again in background
+        QByteArray bytes;
+        bool stale = false;
+        int generation = osmScoutMaster->renderGeneration();
+        bool found = m_tile_cache.get(key, generation, bytes, m_tile_cache_serve_stale ? &stale : nullptr);
+
+        // tiles on disk are sent from file, avoiding copy through the
+        // memory. Only up to date tiles are used from disk, outdated ones
+        // are refreshed in background only if they are kept in memory
+        if ( !found || stale )
+        {
+            size_t size;
+            QByteArray disk_bytes;
+            int fd = m_tile_disk_cache.open(key, osmScoutMaster->renderIdentity(), size);
+            if ( fd >= 0 && (file_reply || TileDiskCache::read(fd, size, disk_bytes)) )
+            {
+                m_tile_stats.addRequest(key, TileStats::CacheHit);
+                if (file_reply) file_reply(fd, size);
+                else reply(disk_bytes, false);
+                return MHD_HTTP_OK;
+            }
+        }
+
+        if ( found )
+        {
+            if (stale)
+                refreshStaleTiles(generation);
+
+            m_tile_stats.addRequest(key, stale ? TileStats::CacheStale : TileStats::CacheHit);
+            reply(bytes, false);
+            return MHD_HTTP_OK;
+        }
+
+        m_tile_stats.addRequest(key, TileStats::CacheMiss);
 
-        Task *task = new Task(connection_id,
-                              std::bind(&DBMaster::renderMap, osmScoutMaster,
-                                        daylight, 96*scale/ntiles, z + shift, 256*scale, 256*scale,
-                                        (tiley2lat(y, z) + tiley2lat(y+1, z))/2.0,
-                                        (tilex2long(x, z) + tilex2long(x+1, z))/2.0, std::placeholders::_1),
+        Task *task = new Task(reply,
+                              std::bind(&RequestMapper::renderTile, this,
+                                        key, std::placeholders::_1),
                               "Error while rendering a tile" );
 
-        m_pool.start(task);
+        if (!m_queue_tile.start(task))
+        {
+            delete task;
+
+            // under overload, any cached version of the tile is better than none
+            if (m_tile_cache.get(key, generation, bytes, &stale))
+            {
+                reply(bytes, false);
+                return MHD_HTTP_OK;
+            }
+
+            overloaded(reply, content_type);
+            return MHD_HTTP_SERVICE_UNAVAILABLE;
+        }
 
-        MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, "image/png");
         return MHD_HTTP_OK;
     }
 
@@ -277,14 +1146,14 @@ unsigned int RequestMapper::service(const char *url_c,
     else if (path == "/v1/search" || path == "/v2/search")
     {
         bool ok = true;
-        size_t limit = q2value<size_t>("limit", 25, connection, ok);
-        QString search = q2value<QString>("search", "", connection, ok);
+        size_t limit = q2value<size_t>("limit", 25, args, ok);
+        QString search = q2value<QString>("search", "", args, ok);
 
         search = search.simplified();
 
         if (!ok || search.length() < 1)
         {
-            errorText(response, connection_id, "Error while reading search query parameters");
+            errorText(reply, content_type, "Error while reading search query parameters");
             return MHD_HTTP_BAD_REQUEST;
         }
 
@@ -292,20 +1161,25 @@ unsigned int RequestMapper::service(const char *url_c,
         bool extended_reply = (path == "/v2/search");
 
         if ( !useGeocoderNLP )
-            task = new Task(connection_id,
+            task = new Task(reply,
                               std::bind( &DBMaster::searchExposed, osmScoutMaster,
                                          search, std::placeholders::_1, limit),
                               "Error while searching");
         else
-            task = new Task(connection_id,
+            task = new Task(reply,
                             std::bind( &GeoMaster::searchExposed, geoMaster,
                                        search, std::placeholders::_1, limit,
                                        extended_reply),
                             "Error while searching");
 
-        m_pool.start(task);
+        if (!m_queue_search.start(task))
+        {
+            delete task;
+            overloaded(reply, content_type);
+            return MHD_HTTP_SERVICE_UNAVAILABLE;
+        }
 
-        MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, "text/plain; charset=UTF-8");
+        content_type = "text/plain; charset=UTF-8";
         return MHD_HTTP_OK;
     }
 
@@ -314,56 +1188,66 @@ unsigned int RequestMapper::service(const char *url_c,
     else if (path == "/v1/guide")
     {
         bool ok = true;
-        double radius = q2value<double>("radius", 1000.0, connection, ok);
-        size_t limit = q2value<size_t>("limit", 50, connection, ok);
-        QString poitype = q2value<QString>("poitype", "", connection, ok);
-        QString search = q2value<QString>("search", "", connection, ok);
-        double lon = q2value<double>("lng", 0, connection, ok);
-        double lat = q2value<double>("lat", 0, connection, ok);
+        double radius = q2value<double>("radius", 1000.0, args, ok);
+        size_t limit = q2value<size_t>("limit", 50, args, ok);
+        QString poitype = q2value<QString>("poitype", "", args, ok);
+        QString search = q2value<QString>("search", "", args, ok);
+        double lon = q2value<double>("lng", 0, args, ok);
+        double lat = q2value<double>("lat", 0, args, ok);
 
         if (!ok)
         {
-            errorText(response, connection_id, "Error while reading guide query parameters");
+            errorText(reply, content_type, "Error while reading guide query parameters");
             return MHD_HTTP_BAD_REQUEST;
         }
 
         search = search.simplified();
 
-        if ( has("lng", connection) && has("lat", connection) )
+        if ( has("lng", args) && has("lat", args) )
         {
-            Task *task = new Task(connection_id,
+            Task *task = new Task(reply,
                                   std::bind(&DBMaster::guide, osmScoutMaster,
                                             poitype, lat, lon, radius, limit, std::placeholders::_1),
                                   "Error while looking for POIs in guide");
-            m_pool.start(task);
+            if (!m_queue_guide.start(task))
+            {
+                delete task;
+                overloaded(reply, content_type);
+                return MHD_HTTP_SERVICE_UNAVAILABLE;
+            }
         }
 
-        else if ( has("search", connection) && search.length() > 0 )
+        else if ( has("search", args) && search.length() > 0 )
         {
             std::string name;
             if (osmScoutMaster->search(search, lat, lon, name))
             {
-                Task *task = new Task(connection_id,
+                Task *task = new Task(reply,
                                       std::bind(&DBMaster::guide, osmScoutMaster,
                                                 poitype, lat, lon, radius, limit, std::placeholders::_1),
                                       "Error while looking for POIs in guide");
-                m_pool.start(task);
+                if (!m_queue_guide.start(task))
+                {
+                    delete task;
+                    overloaded(reply, content_type);
+                    return MHD_HTTP_SERVICE_UNAVAILABLE;
+                }
             }
             else
             {
                 QByteArray bytes;
                 makeEmptyJson(bytes);
-                MicroHTTP::ConnectionStore::setData(connection_id, bytes, false);
+                reply(bytes, false);
             }
         }
 
         else
         {
-            errorText(response, connection_id, "Error in guide query parameters");
+            errorText(reply, content_type, "Error in guide query parameters");
             return MHD_HTTP_BAD_REQUEST;
         }
 
-        MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, "text/plain; charset=UTF-8");
+        content_type = "text/plain; charset=UTF-8";
         return MHD_HTTP_OK;
     }
 
@@ -374,12 +1258,12 @@ unsigned int RequestMapper::service(const char *url_c,
         QByteArray bytes;
         if (!osmScoutMaster->poiTypes(bytes))
         {
-            errorText(response, connection_id, "Error while listing available POI types");
+            errorText(reply, content_type, "Error while listing available POI types");
             return MHD_HTTP_INTERNAL_SERVER_ERROR;
         }
 
-        MicroHTTP::ConnectionStore::setData(connection_id, bytes, false);
-        MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, "text/plain; charset=UTF-8");
+        reply(bytes, false);
+        content_type = "text/plain; charset=UTF-8";
         return MHD_HTTP_OK;
     }
 
@@ -388,9 +1272,9 @@ unsigned int RequestMapper::service(const char *url_c,
     else if (path == "/v1/route")
     {
         bool ok = true;
-        QString type = q2value<QString>("type", "car", connection, ok);
-        double radius = q2value<double>("radius", 1000.0, connection, ok);
-        bool gpx = q2value<int>("gpx", 0, connection, ok);
+        QString type = q2value<QString>("type", "car", args, ok);
+        double radius = q2value<double>("radius", 1000.0, args, ok);
+        bool gpx = q2value<int>("gpx", 0, args, ok);
 
         std::vector<osmscout::GeoCoord> points;
         std::vector< std::string > names;
@@ -399,22 +1283,22 @@ unsigned int RequestMapper::service(const char *url_c,
         for (int i=0; !points_done && ok; ++i)
         {
             QString prefix = "p[" + QString::number(i) + "]";
-            if ( has(prefix + "[lng]", connection) && has(prefix + "[lat]", connection) )
+            if ( has(prefix + "[lng]", args) && has(prefix + "[lat]", args) )
             {
-                double lon = q2value<double>(prefix + "[lng]", 0, connection, ok);
-                double lat = q2value<double>(prefix + "[lat]", 0, connection, ok);
+                double lon = q2value<double>(prefix + "[lng]", 0, args, ok);
+                double lat = q2value<double>(prefix + "[lat]", 0, args, ok);
                 osmscout::GeoCoord c(lat,lon);
                 points.push_back(c);
                 names.push_back(std::string());
             }
 
-            else if ( has(prefix + "[search]", connection) )
+            else if ( has(prefix + "[search]", args) )
             {
-                QString search = q2value<QString>(prefix + "[search]", "", connection, ok);                
+                QString search = q2value<QString>(prefix + "[search]", "", args, ok);                
                 search = search.simplified();
                 if (search.length()<1)
                 {
-                    errorText(response, connection_id, "Error in routing parameters: search term is missing" );
+                    errorText(reply, content_type, "Error in routing parameters: search term is missing" );
                     return MHD_HTTP_BAD_REQUEST;
                 }
 
@@ -437,7 +1321,7 @@ unsigned int RequestMapper::service(const char *url_c,
 
         if (!ok || points.size() < 2)
         {
-            errorText(response, connection_id, "Error in routing parameters: too few routing points" );
+            errorText(reply, content_type, "Error in routing parameters: too few routing points" );
             return MHD_HTTP_BAD_REQUEST;
         }
 
@@ -447,24 +1331,276 @@ unsigned int RequestMapper::service(const char *url_c,
         else if (type == "foot") vehicle = osmscout::vehicleFoot;
         else
         {
-            errorText(response, connection_id, "Error in routing parameters: unknown vehicle" );
+            errorText(reply, content_type, "Error in routing parameters: unknown vehicle" );
+            return MHD_HTTP_BAD_REQUEST;
+        }
+
+        // long routes are sent in chunks while they are serialized
+        QRunnable *task;
+        if (stream_reply)
+            task = new StreamTask(stream_reply,
+                                  std::bind(&DBMaster::route, osmScoutMaster,
+                                            vehicle, points, radius, names, gpx,
+                                            std::placeholders::_1, std::placeholders::_2),
+                                  "Error while looking for route");
+        else
+            task = new Task(reply,
+                            std::bind(&DBMaster::route, osmScoutMaster,
+                                      vehicle, points, radius, names, gpx,
+                                      std::placeholders::_1, DBMaster::OutputSink()),
+                            "Error while looking for route");
+
+        if (!m_queue_route.start(task))
+        {
+            delete task;
+            overloaded(reply, content_type);
+            return MHD_HTTP_SERVICE_UNAVAILABLE;
+        }
+
+        if (!gpx) content_type = "text/plain; charset=UTF-8";
+        else content_type = "text/xml; charset=UTF-8";
+        return MHD_HTTP_OK;
+    }
+
+    //////////////////////////////////////////////////////////////////////
+    /// TILE STATISTICS: REQUESTS HEATMAP, CACHE HITS, AND RENDERING COST
+    else if (path == "/v1/stats/tiles")
+    {
+        bool ok = true;
+        bool reset = q2value<int>("reset", 0, args, ok);
+
+        if (!ok)
+        {
+            errorText(reply, content_type, "Error while reading tile statistics query parameters");
+            return MHD_HTTP_BAD_REQUEST;
+        }
+
+        QByteArray bytes = m_tile_stats.toJson();
+        if (reset)
+            m_tile_stats.reset();
+
+        reply(bytes, false);
+        content_type = "application/json; charset=UTF-8";
+        return MHD_HTTP_OK;
+    }
+
+    //////////////////////////////////////////////////////////////////////
+    /// RENDERING PROFILE: TIMINGS OF RENDERING PHASES PER ZOOM LEVEL
+    else if (path == "/v1/stats/render")
+    {
+        bool ok = true;
+        bool reset = q2value<int>("reset", 0, args, ok);
+        bool log = q2value<int>("log", 0, args, ok);
+
+        if (!ok)
+        {
+            errorText(reply, content_type, "Error while reading render statistics query parameters");
+            return MHD_HTTP_BAD_REQUEST;
+        }
+
+        RenderProfiler &profiler = osmScoutMaster->renderProfiler();
+        QByteArray bytes = profiler.toJson();
+
+        if (log)
+            InfoHub::logInfo("Rendering profile\n" + profiler.summary(), true);
+        if (reset)
+            profiler.reset();
+
+        reply(bytes, false);
+        content_type = "application/json; charset=UTF-8";
+        return MHD_HTTP_OK;
+    }
+
+    //////////////////////////////////////////////////////////////////////
+    /// METRICS IN PROMETHEUS TEXT FORMAT
+    else if (path == "/v1/metrics")
+    {
+        QByteArray bytes;
+        writeMetrics(bytes);
+        reply(bytes, false);
+        content_type = "text/plain; version=0.0.4; charset=utf-8";
+        return MHD_HTTP_OK;
+    }
+
+    //////////////////////////////////////////////////////////////////////
+    /// TRACE OF THE RECENT REQUESTS IN CHROME TRACE EVENT FORMAT
+    else if (path == "/v1/trace")
+    {
+        bool ok = true;
+        bool reset = q2value<int>("reset", 0, args, ok);
+
+        if (!ok)
+        {
+            errorText(reply, content_type, "Error while reading trace query parameters");
             return MHD_HTTP_BAD_REQUEST;
         }
 
-        Task *task = new Task(connection_id,
-                              std::bind(&DBMaster::route, osmScoutMaster,
-                                        vehicle, points, radius, names, gpx, std::placeholders::_1),
-                              "Error while looking for route");
-        m_pool.start(task);
+        QByteArray bytes = Tracer::toJson();
+        if (reset)
+            Tracer::clear();
 
-        if (!gpx) MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, "text/plain; charset=UTF-8");
-        else MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, "text/xml; charset=UTF-8");
+        reply(bytes, false);
+        content_type = "application/json; charset=UTF-8";
         return MHD_HTTP_OK;
     }
 
     else // command unidentified. return help string
     {
-        errorText(response, connection_id, "Unknown URL path");
+        errorText(reply, content_type, "Unknown URL path");
+        return MHD_HTTP_BAD_REQUEST;
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+/// Batch of requests
+/////////////////////////////////////////////////////////////////////////////
+
+// Collects results of the batch operations. Operations are dispatched in
+// parallel and the results are submitted when all of them have finished
+struct BatchState
+{
+    struct Result
+    {
+        unsigned int status = 0;
+        bool failed = false;
+        QString content_type;
+        QByteArray data;
+    };
+
+    QMutex mutex;
+    std::vector<Result> results;
+    int remaining;
+    RequestMapper::Reply reply;
+};
+
+static void batchFinish(BatchState &state)
+{
+    QJsonArray results;
+    for (const BatchState::Result &r: state.results)
+    {
+        QJsonObject o;
+        o.insert("status", (int)(r.failed ? MHD_HTTP_INTERNAL_SERVER_ERROR : r.status));
+        o.insert("contentType", r.content_type);
+
+        // JSON responses are embedded as they are, the others as strings
+        QJsonParseError error;
+        QJsonDocument doc = QJsonDocument::fromJson(r.data, &error);
+        if (error.error == QJsonParseError::NoError && doc.isObject())
+            o.insert("result", doc.object());
+        else if (error.error == QJsonParseError::NoError && doc.isArray())
+            o.insert("result", doc.array());
+        else
+            o.insert("result", QString::fromUtf8(r.data));
+
+        results.append(o);
+    }
+
+    QByteArray data = QJsonDocument(results).toJson(QJsonDocument::Compact);
+    state.reply(data, false);
+}
+
+static void batchDone(const std::shared_ptr<BatchState> &state)
+{
+    bool finished;
+    {
+        QMutexLocker lk(&state->mutex);
+        finished = ( --state->remaining == 0 );
+    }
+
+    if (finished)
+        batchFinish(*state);
+}
+
+static QString jsonToArgument(const QJsonValue &v)
+{
+    if (v.isBool()) return v.toBool() ? "1" : "0";
+    if (v.isString()) return v.toString();
+    return v.toVariant().toString();
+}
+
+// points given by search terms are geocoded while dispatching the
+// request. In batch, it would block the network thread for each of the
+// operations, such points have to be given by coordinates
+static bool batchGeocodes(const QString &path, const RequestMapper::Arguments &args)
+{
+    if (path == "/v1/guide")
+        return args.contains("search") && !(args.contains("lng") && args.contains("lat"));
+
+    if (path == "/v1/route")
+        for (RequestMapper::Arguments::const_iterator iter = args.constBegin(); iter != args.constEnd(); ++iter)
+            if (iter.key().startsWith("p[") && iter.key().endsWith("][search]"))
+                return true;
+
+    return false;
+}
+
+unsigned int RequestMapper::batch(const QByteArray &body, const Reply &reply, QString &content_type)
+{
+    QJsonParseError error;
+    QJsonDocument doc = QJsonDocument::fromJson(body, &error);
+    if (error.error != QJsonParseError::NoError || !doc.isArray())
+    {
+        errorText(reply, content_type, "Error while parsing batch request: expected JSON array");
+        return MHD_HTTP_BAD_REQUEST;
+    }
+
+    QJsonArray ops = doc.array();
+    if (ops.size() > m_batch_max_operations)
+    {
+        errorText(reply, content_type, "Too many operations in batch request");
         return MHD_HTTP_BAD_REQUEST;
     }
+
+    // one reference is held by the loop below to ensure that the
+    // results are submitted after all operations have been dispatched
+    std::shared_ptr<BatchState> state = std::make_shared<BatchState>();
+    state->results.resize(ops.size());
+    state->remaining = ops.size() + 1;
+    state->reply = reply;
+
+    for (int i=0; i < ops.size(); ++i)
+    {
+        QJsonObject op = ops[i].toObject();
+        QString path = op.value("path").toString();
+
+        Arguments args;
+        QJsonObject jargs = op.value("args").toObject();
+        for (QJsonObject::const_iterator iter = jargs.constBegin(); iter != jargs.constEnd(); ++iter)
+            args.insert(iter.key(), jsonToArgument(iter.value()));
+
+        // each operation submits its response through its own collector
+        Reply collector = [state, i](QByteArray &data, bool error) {
+            {
+                QMutexLocker lk(&state->mutex);
+                state->results[i].data = data;
+                state->results[i].failed = error;
+            }
+            batchDone(state);
+        };
+
+        QString op_content_type;
+        unsigned int status;
+        if (path != "/v1/search" && path != "/v2/search" &&
+                path != "/v1/route" && path != "/v1/guide")
+        {
+            errorText(collector, op_content_type, "Only search, route and guide are supported in batch request");
+            status = MHD_HTTP_BAD_REQUEST;
+        }
+        else if (batchGeocodes(path, args))
+        {
+            errorText(collector, op_content_type, "Points given by search are not supported in batch request, use coordinates");
+            status = MHD_HTTP_BAD_REQUEST;
+        }
+        else
+            status = dispatch(path, args, collector, op_content_type);
+
+        QMutexLocker lk(&state->mutex);
+        state->results[i].status = status;
+        state->results[i].content_type = op_content_type;
+    }
+
+    content_type = "application/json; charset=UTF-8";
+    batchDone(state);
+
+    return MHD_HTTP_OK;
 }
@@ -7,7 +7,22 @@
 #define REQUESTMAPPER_H
 
 #include "microhttpservicebase.h"
+#include "endpointqueue.h"
+#include "tilecache.h"
+#include "tilediskcache.h"
+#include "tilestats.h"
+#include "watchdog.h"
+
 #include <QThreadPool>
+#include <QString>
+#include <QHash>
+#include <QByteArray>
+#include <QMutex>
+#include <QSet>
+#include <QWaitCondition>
+
+#include <atomic>
+#include <functional>
 
 /**
   The request mapper dispatches incoming HTTP requests to controller classes
@@ -16,6 +31,28 @@
 
 class RequestMapper : public MicroHTTP::ServiceBase
 {
+public:
+    /// Query arguments of the request
+    typedef QHash<QString, QString> Arguments;
+
+    /// Callback used to submit the response data. Could be called from
+    /// the dispatch function directly or later from the worker thread.
+    /// Error is set if the request has failed, data holds the error message
+    typedef std::function<void(QByteArray &data, bool error)> Reply;
+
+    /// Callback used to submit the response given by a file. Takes
+    /// ownership of the file descriptor. Transports that can send files
+    /// directly provide it to dispatch
+    typedef std::function<void(int fd, size_t size)> FileReply;
+
+    /// Callback used to submit the response in chunks, as they are
+    /// produced. The last call has to be with finish set to true. Error
+    /// is set on the last call if the request has failed: if nothing has
+    /// been streamed yet, data is sent as the error message, otherwise
+    /// the response is aborted. Returns false if the client is gone and
+    /// the response should be aborted
+    typedef std::function<bool(const QByteArray &data, bool finish, bool error)> StreamReply;
+
 public:
 
     RequestMapper();
@@ -26,10 +63,103 @@ public:
     */
     virtual unsigned int service(const char *url, MHD_Connection *, MHD_Response *,
                                  MicroHTTP::Connection::keytype connection_id);
+
+    /**
+      Serve POST requests. Only batch of requests at /v1/batch is supported.
+    */
+    virtual unsigned int servicePost(const char *url, const QByteArray &body,
+                                     MHD_Connection *, MHD_Response *,
+                                     MicroHTTP::Connection::keytype connection_id);
+
+    /**
+      Dispatch request given by path and query arguments independent of
+      the used transport. Returns HTTP status code, fills content type of
+      the response, and submits the response through reply.
+    */
+    unsigned int dispatch(const QString &path, const Arguments &args,
+                          const Reply &reply, QString &content_type,
+                          const FileReply &file_reply = FileReply(),
+                          const StreamReply &stream_reply = StreamReply());
     virtual void loguri(const char *uri);
 
+    virtual uint64_t requestStarted(const char *url);
+    virtual void requestCompleted(uint64_t id, bool ok);
+
+    /// \brief Render tiles requested most often during the previous session
+    ///
+    /// Tiles are rendered in the background by a single low priority job
+    /// and are inserted into the tile cache
+    void warmupTiles();
+
 protected:
-    QThreadPool m_pool;
+    unsigned int serve(const char *url, const QByteArray *body,
+                       MHD_Connection *connection, MHD_Response *response,
+                       MicroHTTP::Connection::keytype connection_id);
+
+    /// \brief Dispatch operations given as JSON array in parallel
+    ///
+    /// Each operation is given as {"path": ..., "args": {...}}. Only
+    /// search, route and guide with the points given by coordinates are
+    /// supported. Reply is submitted after all operations have finished,
+    /// with the results in the order of operations
+    unsigned int batch(const QByteArray &body, const Reply &reply, QString &content_type);
+
+    bool renderTile(const TileCache::Key &key, QByteArray &result);
+    void renderHotTiles(const QList<TileCache::Key> &keys);
+
+    /// \brief Start background rendering of outdated tiles, once per generation
+    void refreshStaleTiles(int generation);
+    void renderStaleTiles(int generation);
+    void saveHotTiles();
+
+    /// \brief Metrics of the server and its components in Prometheus text format
+    void writeMetrics(QByteArray &result);
+
+    /// \brief Deadline of the requests to the path in milliseconds, 0 if none
+    int deadline(const QString &path) const;
+
+protected:
+    // separate worker pools isolate the endpoints from each other
+    QThreadPool m_pool_tile;
+    QThreadPool m_pool_search;
+    QThreadPool m_pool_guide;
+    QThreadPool m_pool_route;
+
+    // admission control of the requests
+    EndpointQueue m_queue_tile{"tile"};
+    EndpointQueue m_queue_search{"search"};
+    EndpointQueue m_queue_guide{"guide"};
+    EndpointQueue m_queue_route{"route"};
+
+    // responses smaller than this are not compressed, negative to disable
+    int m_compression_min_size;
+
+    int m_batch_max_operations;
+    QByteArray m_retry_after; ///< seconds, sent with rejected requests
+
+    // deadlines of the endpoints in milliseconds, 0 if not limited
+    int m_deadline_tile;
+    int m_deadline_search;
+    int m_deadline_guide;
+    int m_deadline_route;
+    Watchdog m_watchdog;
+
+    TileCache m_tile_cache;
+    TileDiskCache m_tile_disk_cache;
+    TileStats m_tile_stats;
+    QString m_tile_cache_hot_fname;
+    int m_tile_cache_hot_size;
+    bool m_tile_cache_serve_stale;
+    std::atomic<int> m_tiles_refresh_generation{0};
+
+    // tiles are rendered in blocks of m_metatile_size x m_metatile_size
+    int m_metatile_size;
+    QMutex m_metatile_mutex;
+    QWaitCondition m_metatile_rendered;
+    QSet<TileCache::Key> m_metatiles_rendering;
+
+    std::atomic<int> m_tiles_rendered{0};
+    std::atomic<bool> m_shutdown{false};
 };
 
 #endif // REQUESTMAPPER_H
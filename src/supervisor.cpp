@@ -0,0 +1,162 @@
+#include "supervisor.h"
+
+#include <iostream>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+int Supervisor::s_worker = 0;
+
+static volatile sig_atomic_t stop_requested = 0;
+static int stop_pipe[2] = { -1, -1 };
+
+static void on_stop_signal(int)
+{
+    stop_requested = 1;
+}
+
+// only async-signal-safe calls are allowed, the event loop is woken up
+// through the pipe
+static void on_stop_signal_pipe(int)
+{
+    int saved_errno = errno;
+    char c = 1;
+    ssize_t r = write(stop_pipe[1], &c, 1); // fails if the stop is pending already
+    (void)r;
+    errno = saved_errno;
+}
+
+static void set_signal_handler(void (*handler)(int), int flags = 0)
+{
+    // no SA_RESTART by default: waitpid is interrupted to check for the
+    // stop request
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handler;
+    sa.sa_flags = flags;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+}
+
+// Returns pid of the started worker in the supervisor, 0 in the worker
+// and -1 on error
+static pid_t start_worker(int index, int &worker)
+{
+    pid_t pid = fork();
+    if (pid != 0)
+        return pid;
+
+    worker = index;
+    set_signal_handler(SIG_DFL);
+
+#ifdef __linux__
+    // workers are stopped if the supervisor is killed
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    if (getppid() == 1)
+        _exit(0);
+#endif
+
+    return 0;
+}
+
+int Supervisor::watchStopSignals()
+{
+    if (stop_pipe[0] < 0 && pipe2(stop_pipe, O_CLOEXEC | O_NONBLOCK) != 0)
+    {
+        stop_pipe[0] = stop_pipe[1] = -1;
+        return -1;
+    }
+
+    set_signal_handler(on_stop_signal_pipe, SA_RESTART);
+    return stop_pipe[0];
+}
+
+bool Supervisor::run(int processes, int &status)
+{
+    status = 0;
+    set_signal_handler(on_stop_signal);
+
+    std::vector<pid_t> workers(processes, -1);
+    for (int i=0; i < processes; ++i)
+    {
+        pid_t pid = start_worker(i, s_worker);
+        if (pid == 0) return true;
+        if (pid < 0)
+        {
+            std::cerr << "Failed to start worker " << i << ": " << strerror(errno) << std::endl;
+            stop_requested = 1;
+            status = -1;
+            break;
+        }
+        workers[i] = pid;
+    }
+
+    std::cout << "Supervisor: started " << processes << " workers" << std::endl;
+
+    int running = 0;
+    for (pid_t p: workers)
+        if (p > 0) ++running;
+
+    bool stopping = false;
+    while (running > 0)
+    {
+        if (stop_requested && !stopping)
+        {
+            stopping = true;
+            for (pid_t p: workers)
+                if (p > 0) kill(p, SIGTERM);
+        }
+
+        int wstatus;
+        pid_t pid = waitpid(-1, &wstatus, 0);
+        if (pid < 0)
+        {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        for (int i=0; i < processes; ++i)
+        {
+            if (workers[i] != pid)
+                continue;
+
+            workers[i] = -1;
+            --running;
+
+            if (stopping || stop_requested)
+                break;
+
+            std::cerr << "Supervisor: worker " << i << " exited with status " << wstatus
+                      << ", restarting" << std::endl;
+
+            // avoid busy loop when the workers fail on startup
+            sleep(1);
+
+            pid_t restarted = start_worker(i, s_worker);
+            if (restarted == 0) return true;
+            if (restarted > 0)
+            {
+                workers[i] = restarted;
+                ++running;
+            }
+            else
+                std::cerr << "Failed to restart worker " << i << ": " << strerror(errno) << std::endl;
+
+            break;
+        }
+    }
+
+    std::cout << "Supervisor: all workers stopped" << std::endl;
+    return false;
+}
@@ -0,0 +1,38 @@
+#ifndef SUPERVISOR_H
+#define SUPERVISOR_H
+
+/// \brief Runs the server as several worker processes
+///
+/// Used by the console version on multi-core servers. Workers are forked
+/// before the application object is created and listen on the same port using
+/// SO_REUSEPORT, the kernel distributing connections between them. Map
+/// data is memory mapped by each worker and shared through the page
+/// cache. Supervisor restarts the workers that have exited and stops all
+/// of them on SIGTERM or SIGINT.
+class Supervisor
+{
+public:
+    /// \brief Start the workers and supervise them until stopped
+    ///
+    /// Returns true in the worker process that should continue with the
+    /// startup of the server. In the supervisor, returns false when all
+    /// workers have stopped, with the exit status set
+    static bool run(int processes, int &status);
+
+    /// \brief Index of the worker process, starting from 0
+    ///
+    /// Is 0 when running without supervisor
+    static int worker() { return s_worker; }
+
+    /// \brief Catch SIGTERM and SIGINT for the clean shutdown
+    ///
+    /// Returns file descriptor that becomes readable when a signal has
+    /// arrived, -1 on error. Used by the workers and by the server
+    /// running without supervisor
+    static int watchStopSignals();
+
+protected:
+    static int s_worker;
+};
+
+#endif // SUPERVISOR_H
@@ -0,0 +1,173 @@
+#include "tilecache.h"
+
+#include <QMutexLocker>
+#include <QFile>
+#include <QSaveFile>
+#include <QStringList>
+#include <QTextStream>
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include <vector>
+
+uint qHash(const TileCache::Key &key, uint seed)
+{
+    return qHash( (key.z << 24) ^ (key.x << 12) ^ key.y ^
+                  (key.shift << 28) ^ (key.scale << 20) ^ (key.daylight ? 0x80000000 : 0),
+                  seed );
+}
+
+QString TileCache::Key::toString() const
+{
+    return QString("%1 %2 %3 %4 %5 %6").
+            arg(daylight ? 1 : 0).arg(shift).arg(scale).arg(z).arg(x).arg(y);
+}
+
+bool TileCache::Key::fromString(const QString &s, Key &key)
+{
+    QStringList l = s.split(' ', QString::SkipEmptyParts);
+    if (l.size() != 6)
+        return false;
+
+    bool ok = true;
+    bool this_ok;
+    key.daylight = (l[0].toInt(&this_ok) > 0); ok = ok && this_ok;
+    key.shift = l[1].toInt(&this_ok); ok = ok && this_ok;
+    key.scale = l[2].toInt(&this_ok); ok = ok && this_ok;
+    key.z = l[3].toInt(&this_ok); ok = ok && this_ok;
+    key.x = l[4].toInt(&this_ok); ok = ok && this_ok;
+    key.y = l[5].toInt(&this_ok); ok = ok && this_ok;
+
+    return ok;
+}
+
+TileCache::TileCache()
+{
+}
+
+void TileCache::setMaxSize(int kbytes)
+{
+    QMutexLocker lk(&m_mutex);
+    m_cache.setMaxCost(std::max(0, kbytes));
+}
+
+bool TileCache::get(const Key &key, int generation, QByteArray &data, bool *stale)
+{
+    QMutexLocker lk(&m_mutex);
+    Entry *e = m_cache.object(key);
+    if (e == nullptr)
+        return false;
+
+    e->hits++;
+    if (e->generation != generation && stale == nullptr)
+        return false;
+
+    if (stale != nullptr)
+        *stale = (e->generation != generation);
+
+    data = e->data;
+    return true;
+}
+
+bool TileCache::contains(const Key &key, int generation)
+{
+    QMutexLocker lk(&m_mutex);
+    Entry *e = m_cache.object(key);
+    return (e != nullptr && e->generation == generation);
+}
+
+void TileCache::insert(const Key &key, int generation, const QByteArray &data, bool requested)
+{
+    QMutexLocker lk(&m_mutex);
+
+    size_t hits = requested ? 1 : 0;
+    Entry *old = m_cache.object(key);
+    if (old != nullptr)
+        hits = old->hits;
+
+    Entry *e = new Entry;
+    e->data = data;
+    e->generation = generation;
+    e->hits = hits;
+
+    // cost is given in kilobytes, rounded up
+    m_cache.insert(key, e, data.size() / 1024 + 1);
+}
+
+void TileCache::clear()
+{
+    QMutexLocker lk(&m_mutex);
+    m_cache.clear();
+}
+
+QList<TileCache::Key> TileCache::hotKeys(int number)
+{
+    return keysByHits(number, [](const Entry &) { return true; });
+}
+
+QList<TileCache::Key> TileCache::staleKeys(int generation)
+{
+    return keysByHits(std::numeric_limits<int>::max(),
+                      [generation](const Entry &e) { return e.generation != generation; });
+}
+
+QList<TileCache::Key> TileCache::keysByHits(int number, const std::function<bool(const Entry &e)> &filter)
+{
+    std::vector< std::pair<size_t, Key> > all;
+    {
+        QMutexLocker lk(&m_mutex);
+        for (const Key &k: m_cache.keys())
+        {
+            const Entry *e = m_cache.object(k);
+            if (filter(*e))
+                all.push_back(std::make_pair(e->hits, k));
+        }
+    }
+
+    std::stable_sort(all.begin(), all.end(),
+                     [](const std::pair<size_t, Key> &a, const std::pair<size_t, Key> &b) {
+        return a.first > b.first;
+    });
+
+    QList<Key> keys;
+    for (size_t i=0; i < all.size() && keys.size() < number; ++i)
+        keys.append(all[i].second);
+
+    return keys;
+}
+
+bool TileCache::saveHotKeys(const QString &fname, int number)
+{
+    QList<Key> keys = hotKeys(number);
+
+    QSaveFile file(fname);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+        return false;
+
+    {
+        QTextStream output(&file);
+        for (const Key &k: keys)
+            output << k.toString() << "\n";
+    }
+
+    return file.commit();
+}
+
+QList<TileCache::Key> TileCache::loadHotKeys(const QString &fname)
+{
+    QList<Key> keys;
+    QFile file(fname);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+        return keys;
+
+    QTextStream input(&file);
+    while (!input.atEnd())
+    {
+        Key k;
+        if (Key::fromString(input.readLine(), k))
+            keys.append(k);
+    }
+
+    return keys;
+}
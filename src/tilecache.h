@@ -0,0 +1,91 @@
+#ifndef TILECACHE_H
+#define TILECACHE_H
+
+#include <QByteArray>
+#include <QCache>
+#include <QList>
+#include <QMutex>
+#include <QString>
+
+#include <functional>
+
+/// \brief In-memory cache of rendered tiles
+///
+/// Thread safe cache of rendered tiles. Together with the tile data, the
+/// number of requests for each tile is recorded. This allows to save keys
+/// of the most requested tiles on shutdown and render them again in the
+/// background on the next start.
+class TileCache
+{
+public:
+    struct Key
+    {
+        bool daylight;
+        int shift;
+        int scale;
+        int x;
+        int y;
+        int z;
+
+        bool operator==(const Key &k) const
+        {
+            return daylight == k.daylight && shift == k.shift && scale == k.scale &&
+                    x == k.x && y == k.y && z == k.z;
+        }
+
+        QString toString() const;
+        static bool fromString(const QString &s, Key &key);
+    };
+
+public:
+    TileCache();
+
+    /// \brief Set maximal size of the cache in kilobytes
+    void setMaxSize(int kbytes);
+
+    /// \brief Look up the tile and count the request
+    ///
+    /// Returns true if the tile was found and was rendered with the given
+    /// generation of the rendering settings. If stale is given, tiles
+    /// rendered with other generations are returned as well with stale
+    /// set to true
+    bool get(const Key &key, int generation, QByteArray &data, bool *stale = nullptr);
+
+    /// \brief Check whether the tile is available without counting it as a request
+    bool contains(const Key &key, int generation);
+
+    /// \brief Insert the tile
+    ///
+    /// Set requested to false for tiles rendered in advance, those are
+    /// not counted as requests
+    void insert(const Key &key, int generation, const QByteArray &data, bool requested = true);
+
+    void clear();
+
+    /// \brief Keys of the most requested tiles, the most popular first
+    QList<Key> hotKeys(int number);
+
+    /// \brief Keys of the tiles rendered with other than the given generation, the most popular first
+    QList<Key> staleKeys(int generation);
+
+    bool saveHotKeys(const QString &fname, int number);
+    static QList<Key> loadHotKeys(const QString &fname);
+
+protected:
+    struct Entry
+    {
+        QByteArray data;
+        int generation;
+        size_t hits;
+    };
+
+    QList<Key> keysByHits(int number, const std::function<bool(const Entry &e)> &filter);
+
+protected:
+    QMutex m_mutex;
+    QCache<Key, Entry> m_cache;
+};
+
+uint qHash(const TileCache::Key &key, uint seed = 0);
+
+#endif // TILECACHE_H
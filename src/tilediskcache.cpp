@@ -0,0 +1,160 @@
+#include "tilediskcache.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include <algorithm>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+TileDiskCache::Entry::~Entry()
+{
+    if (!fname.isEmpty())
+        QFile::remove(fname);
+}
+
+TileDiskCache::TileDiskCache()
+{
+}
+
+QString TileDiskCache::location()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/tiles";
+}
+
+bool TileDiskCache::remove(const QString &dirname)
+{
+    QDir dir(dirname);
+    return !dir.exists() || dir.removeRecursively();
+}
+
+bool TileDiskCache::setup(const QString &dirname, int kbytes, bool shared)
+{
+    QMutexLocker lk(&m_mutex);
+
+    m_index.clear();
+    m_enabled = false;
+    m_shared = shared;
+    m_dirname = dirname;
+
+    // files from the previous session are not in the index and would
+    // not be limited in size. Shared cache is cleared by the supervisor
+    // instead
+    if (!shared && !remove(dirname))
+        return false;
+
+    if (kbytes <= 0)
+        return true;
+
+    if (!QDir().mkpath(dirname))
+        return false;
+
+    m_index.setMaxCost(kbytes);
+    m_enabled = true;
+    return true;
+}
+
+QString TileDiskCache::filename(const TileCache::Key &key, const QString &identity) const
+{
+    return QString("%1/%2/%3-%4-%5/%6/%7/%8.png").arg(m_dirname).arg(identity).
+            arg(key.daylight ? 1 : 0).arg(key.shift).arg(key.scale).
+            arg(key.z).arg(key.x).arg(key.y);
+}
+
+int TileDiskCache::open(const TileCache::Key &key, const QString &identity, size_t &size)
+{
+    QString fname;
+    {
+        QMutexLocker lk(&m_mutex);
+        if (!m_enabled)
+            return -1;
+
+        Entry *e = m_index.object(key);
+        if (e != nullptr && e->identity == identity)
+            fname = e->fname;
+        else if (m_shared)
+            fname = filename(key, identity); // could be written by another process
+        else
+            return -1;
+    }
+
+    // file could be removed or replaced after releasing the lock. In the
+    // first case, it is considered as a cache miss
+    int fd = ::open(QFile::encodeName(fname).constData(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+
+    size = st.st_size;
+    return fd;
+}
+
+bool TileDiskCache::read(int fd, size_t size, QByteArray &data)
+{
+    QFile file;
+    bool ok = file.open(fd, QIODevice::ReadOnly, QFileDevice::AutoCloseHandle);
+    if (ok)
+    {
+        data = file.readAll();
+        ok = ( (size_t)data.size() == size );
+    }
+    else
+        ::close(fd);
+
+    return ok;
+}
+
+void TileDiskCache::insert(const TileCache::Key &key, const QString &identity, const QByteArray &data)
+{
+    if (!m_enabled)
+        return;
+
+    QString fname = filename(key, identity);
+    if (!QDir().mkpath(QFileInfo(fname).path()))
+        return;
+
+    // data is written into temporary file and renamed on commit
+    QSaveFile file(fname);
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size())
+        return;
+
+    QMutexLocker lk(&m_mutex);
+    if (!file.commit())
+        return;
+
+    // old entry with the same identity refers to the file which has been
+    // replaced already. Files rendered with other settings are removed
+    Entry *old = m_index.take(key);
+    if (old != nullptr)
+    {
+        if (old->fname == fname)
+            old->fname.clear();
+        delete old;
+    }
+
+    Entry *e = new Entry;
+    e->fname = fname;
+    e->identity = identity;
+
+    // cost is given in kilobytes, rounded up. Evicted files are removed
+    m_index.insert(key, e, data.size() / 1024 + 1);
+}
+
+void TileDiskCache::clear()
+{
+    QMutexLocker lk(&m_mutex);
+    m_index.clear();
+}
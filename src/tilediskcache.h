@@ -0,0 +1,79 @@
+#ifndef TILEDISKCACHE_H
+#define TILEDISKCACHE_H
+
+#include "tilecache.h"
+
+#include <QByteArray>
+#include <QCache>
+#include <QMutex>
+#include <QString>
+
+/// \brief On-disk cache of rendered tiles
+///
+/// Second tier of the tile cache, larger than the in-memory cache. Tiles
+/// are stored as files and can be sent by the HTTP server directly from
+/// the file descriptor. Files are written to a temporary file first and
+/// renamed into place, so readers never see partially written tiles. The
+/// index of the cached tiles is kept in memory and the least recently used
+/// files are removed when the size limit is reached. Since the files of
+/// the previous session are not indexed, the cache is cleared on start.
+/// Thread safe.
+///
+/// Tiles are stored under the identity of the rendering settings (see
+/// DBMaster::renderIdentity). In the shared mode, the same directory is
+/// used by several server processes. As the identity is the same in all
+/// processes using the same settings, tiles written by the other
+/// processes are found by their file name. Each
+/// process limits the size of the files it has written. Concurrent
+/// writers of the same tile replace the file atomically.
+class TileDiskCache
+{
+public:
+    TileDiskCache();
+
+    /// \brief Set directory and maximal size of the cache in kilobytes
+    ///
+    /// The directory is cleared unless the cache is shared with other
+    /// processes. Cache is disabled if the size is zero
+    bool setup(const QString &dirname, int kbytes, bool shared = false);
+
+    /// \brief Default directory of the cache
+    static QString location();
+
+    /// \brief Remove the cache directory with all tiles in it
+    static bool remove(const QString &dirname);
+
+    bool enabled() const { return m_enabled; }
+
+    /// \brief Open the tile file for reading
+    ///
+    /// Returns file descriptor that has to be closed by the caller or -1
+    /// if the tile rendered with the given settings identity is not available
+    int open(const TileCache::Key &key, const QString &identity, size_t &size);
+
+    /// \brief Read the file opened by open() into memory and close it
+    static bool read(int fd, size_t size, QByteArray &data);
+
+    void insert(const TileCache::Key &key, const QString &identity, const QByteArray &data);
+
+    void clear();
+
+protected:
+    struct Entry
+    {
+        ~Entry(); ///< Removes the file
+        QString fname;
+        QString identity;
+    };
+
+    QString filename(const TileCache::Key &key, const QString &identity) const;
+
+protected:
+    QMutex m_mutex;
+    QCache<TileCache::Key, Entry> m_index;
+    QString m_dirname;
+    bool m_enabled = false;
+    bool m_shared = false;
+};
+
+#endif // TILEDISKCACHE_H
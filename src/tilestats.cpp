@@ -0,0 +1,196 @@
+#include "tilestats.h"
+
+#include <QMutexLocker>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <algorithm>
+#include <cmath>
+
+// cell covers (1 << CELL_SHIFT) x (1 << CELL_SHIFT) tiles
+#define CELL_SHIFT 4
+
+// maximal number of cells kept in memory, for all zoom levels
+#define MAX_CELLS 8192
+
+static double tilex2long(double x, int z)
+{
+    return x / pow(2.0, z) * 360.0 - 180;
+}
+
+static double tiley2lat(double y, int z)
+{
+    double n = M_PI - 2.0 * M_PI * y / pow(2.0, z);
+    return 180.0 / M_PI * atan(0.5 * (exp(n) - exp(-n)));
+}
+
+static int cell_zoom(int z)
+{
+    return std::max(0, z - CELL_SHIFT);
+}
+
+TileStats::TileStats()
+{
+}
+
+TileStats::Counts* TileStats::cell(const TileCache::Key &key)
+{
+    int shift = key.z - cell_zoom(key.z);
+    quint64 id = ( (quint64)key.z << 56 ) |
+            ( (quint64)(key.x >> shift) << 28 ) |
+            (quint64)(key.y >> shift);
+
+    auto iter = m_cells.find(id);
+    if (iter != m_cells.end())
+        return &iter.value();
+
+    if (m_cells.size() >= MAX_CELLS)
+        return nullptr;
+
+    return &m_cells[id];
+}
+
+static bool valid(const TileCache::Key &key)
+{
+    return key.z >= 0 && key.z <= TileStats::MaxZoom &&
+            key.x >= 0 && key.x < (1 << key.z) &&
+            key.y >= 0 && key.y < (1 << key.z);
+}
+
+void TileStats::addRequest(const TileCache::Key &key, Result result)
+{
+    if (!valid(key))
+        return;
+
+    QMutexLocker lk(&m_mutex);
+    Counts *counts[] = { &m_zoom[key.z], cell(key) };
+    for (Counts *c: counts)
+        if (c != nullptr)
+        {
+            c->requests++;
+            if (result == CacheHit) c->hits++;
+            else if (result == CacheStale) c->stale++;
+        }
+}
+
+void TileStats::addRender(const TileCache::Key &key, double msecs)
+{
+    if (!valid(key))
+        return;
+
+    QMutexLocker lk(&m_mutex);
+    Counts *counts[] = { &m_zoom[key.z], cell(key) };
+    for (Counts *c: counts)
+        if (c != nullptr)
+        {
+            c->renders++;
+            c->render_msecs += msecs;
+        }
+}
+
+void TileStats::reset()
+{
+    QMutexLocker lk(&m_mutex);
+    m_zoom.fill(Counts());
+    m_cells.clear();
+}
+
+void TileStats::totals(size_t &requests, size_t &hits, size_t &stale, size_t &renders, double &render_msecs)
+{
+    requests = hits = stale = renders = 0;
+    render_msecs = 0;
+
+    QMutexLocker lk(&m_mutex);
+    for (const Counts &c: m_zoom)
+    {
+        requests += c.requests;
+        hits += c.hits;
+        stale += c.stale;
+        renders += c.renders;
+        render_msecs += c.render_msecs;
+    }
+}
+
+static void fill(QJsonObject &o, size_t requests, size_t hits, size_t stale,
+                 size_t renders, double render_msecs)
+{
+    o.insert("requests", (double)requests);
+    o.insert("hits", (double)hits);
+    o.insert("stale", (double)stale);
+    o.insert("hitRatio", requests > 0 ? (double)(hits + stale) / requests : 0.0);
+    o.insert("renders", (double)renders);
+    o.insert("renderMs", render_msecs);
+    o.insert("meanRenderMs", renders > 0 ? render_msecs / renders : 0.0);
+}
+
+QByteArray TileStats::toJson()
+{
+    QJsonObject root;
+    QJsonArray zooms;
+    QJsonArray cells;
+
+    size_t requests = 0, hits = 0, stale = 0, renders = 0;
+    double render_msecs = 0;
+
+    QMutexLocker lk(&m_mutex);
+
+    for (int z=0; z <= MaxZoom; ++z)
+    {
+        const Counts &c = m_zoom[z];
+        if (c.requests == 0 && c.renders == 0)
+            continue;
+
+        QJsonObject o;
+        o.insert("zoom", z);
+        fill(o, c.requests, c.hits, c.stale, c.renders, c.render_msecs);
+        zooms.append(o);
+
+        requests += c.requests;
+        hits += c.hits;
+        stale += c.stale;
+        renders += c.renders;
+        render_msecs += c.render_msecs;
+    }
+
+    // the most requested cells first
+    QList<quint64> ids = m_cells.keys();
+    std::sort(ids.begin(), ids.end(), [this](quint64 a, quint64 b) {
+        return m_cells.value(a).requests > m_cells.value(b).requests;
+    });
+
+    for (quint64 id: ids)
+    {
+        const Counts c = m_cells.value(id);
+        int z = (int)(id >> 56);
+        int cz = cell_zoom(z);
+        int x = (int)((id >> 28) & 0xFFFFFFF);
+        int y = (int)(id & 0xFFFFFFF);
+
+        QJsonObject o;
+        o.insert("zoom", z);
+        o.insert("cellZoom", cz);
+        o.insert("x", x);
+        o.insert("y", y);
+
+        QJsonArray bbox;
+        bbox.append(tilex2long(x, cz));
+        bbox.append(tiley2lat(y+1, cz));
+        bbox.append(tilex2long(x+1, cz));
+        bbox.append(tiley2lat(y, cz));
+        o.insert("bbox", bbox);
+
+        fill(o, c.requests, c.hits, c.stale, c.renders, c.render_msecs);
+        cells.append(o);
+    }
+
+    QJsonObject total;
+    fill(total, requests, hits, stale, renders, render_msecs);
+
+    root.insert("total", total);
+    root.insert("zoom", zooms);
+    root.insert("cells", cells);
+    root.insert("cellsFull", m_cells.size() >= MAX_CELLS);
+
+    return QJsonDocument(root).toJson();
+}
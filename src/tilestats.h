@@ -0,0 +1,61 @@
+#ifndef TILESTATS_H
+#define TILESTATS_H
+
+#include "tilecache.h"
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+
+#include <array>
+
+/// \brief Statistics of the served tiles
+///
+/// Requests are counted per zoom level and in coarse cells covering
+/// 16x16 tiles, forming a heatmap of the requested regions. For each
+/// cell, cache hits and rendering cost are recorded. The number of cells
+/// is limited; when the limit is reached, requests in new cells are
+/// counted only in the totals of the zoom level. Thread safe.
+class TileStats
+{
+public:
+    enum Result {
+        CacheHit,
+        CacheStale, ///< outdated tile served from cache
+        CacheMiss
+    };
+
+    static const int MaxZoom = 22;
+
+public:
+    TileStats();
+
+    void addRequest(const TileCache::Key &key, Result result);
+    void addRender(const TileCache::Key &key, double msecs);
+
+    void reset();
+
+    /// \brief Totals over all zoom levels
+    void totals(size_t &requests, size_t &hits, size_t &stale, size_t &renders, double &render_msecs);
+
+    QByteArray toJson();
+
+protected:
+    struct Counts
+    {
+        size_t requests = 0;
+        size_t hits = 0;
+        size_t stale = 0;
+        size_t renders = 0;
+        double render_msecs = 0;
+    };
+
+    Counts* cell(const TileCache::Key &key); ///< Has to be called with locked mutex
+
+protected:
+    QMutex m_mutex;
+    std::array<Counts, MaxZoom+1> m_zoom;
+    QHash<quint64, Counts> m_cells;
+};
+
+#endif // TILESTATS_H
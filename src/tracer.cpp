@@ -0,0 +1,295 @@
+#include "tracer.h"
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QTextStream>
+#include <QVector>
+
+#include <algorithm>
+#include <atomic>
+
+#include <unistd.h>
+
+// lanes of the requests are shown after the lanes of the threads
+#define REQUEST_LANE_OFFSET 1000000
+
+namespace {
+
+struct Event
+{
+    quint64 trace = 0;
+    const char *name = nullptr;
+    qint64 start = 0;
+    qint64 end = 0;
+    int lane = 0;
+    QByteArray url; ///< only for the request span
+};
+
+struct Open
+{
+    qint64 start = 0;
+    qint64 ready = -1;
+    QByteArray url;
+};
+
+struct State
+{
+    QMutex mutex;
+    QVector<Event> ring;
+    int next = 0;
+    bool wrapped = false;
+    QHash<quint64, Open> open;
+    std::atomic<bool> enabled{false};
+    std::atomic<quint64> last_trace{0};
+    std::atomic<int> last_thread{0};
+    QElapsedTimer clock;
+
+    State() { clock.start(); }
+
+    void add(const Event &e)
+    {
+        if (ring.isEmpty())
+            return;
+        ring[next] = e;
+        if (++next >= ring.size())
+        {
+            next = 0;
+            wrapped = true;
+        }
+    }
+};
+
+State tracer_state;
+thread_local quint64 current_trace = 0;
+thread_local int thread_lane = 0;
+
+int lane()
+{
+    if (thread_lane == 0)
+        thread_lane = ++tracer_state.last_thread;
+    return thread_lane;
+}
+
+}
+
+void Tracer::setup(int capacity)
+{
+    QMutexLocker lk(&tracer_state.mutex);
+    tracer_state.ring = QVector<Event>(std::max(0, capacity));
+    tracer_state.next = 0;
+    tracer_state.wrapped = false;
+    tracer_state.open.clear();
+    tracer_state.enabled = (capacity > 0);
+}
+
+quint64 Tracer::begin(const char *url)
+{
+    current_trace = 0;
+    if (!tracer_state.enabled)
+        return 0;
+
+    Open o;
+    o.start = now();
+    o.url = url;
+
+    QMutexLocker lk(&tracer_state.mutex);
+
+    // requests that were never finished should not grow the table
+    // without limit. New requests are not traced in this case
+    if (tracer_state.open.size() >= tracer_state.ring.size())
+        return 0;
+
+    quint64 trace = ++tracer_state.last_trace;
+    tracer_state.open.insert(trace, o);
+    current_trace = trace;
+    return trace;
+}
+
+void Tracer::ready(quint64 trace)
+{
+    if (trace == 0)
+        return;
+
+    qint64 t = now();
+    QMutexLocker lk(&tracer_state.mutex);
+    auto iter = tracer_state.open.find(trace);
+    if (iter != tracer_state.open.end() && iter->ready < 0)
+        iter->ready = t;
+}
+
+void Tracer::end(quint64 trace, bool ok)
+{
+    if (trace == 0)
+        return;
+
+    qint64 t = now();
+    QMutexLocker lk(&tracer_state.mutex);
+    auto iter = tracer_state.open.find(trace);
+    if (iter == tracer_state.open.end())
+        return;
+
+    Open o = iter.value();
+    tracer_state.open.erase(iter);
+
+    Event e;
+    e.trace = trace;
+    e.lane = REQUEST_LANE_OFFSET + (int)(trace % REQUEST_LANE_OFFSET);
+
+    if (o.ready >= 0)
+    {
+        e.name = "send";
+        e.start = o.ready;
+        e.end = t;
+        tracer_state.add(e);
+    }
+
+    e.name = (ok ? "request" : "request aborted");
+    e.start = o.start;
+    e.end = t;
+    e.url = o.url;
+    tracer_state.add(e);
+}
+
+quint64 Tracer::current()
+{
+    return current_trace;
+}
+
+void Tracer::setCurrent(quint64 trace)
+{
+    current_trace = trace;
+}
+
+qint64 Tracer::now()
+{
+    return tracer_state.clock.nsecsElapsed();
+}
+
+void Tracer::record(quint64 trace, const char *name, qint64 start, qint64 end, bool request_lane)
+{
+    if (trace == 0)
+        return;
+
+    Event e;
+    e.trace = trace;
+    e.name = name;
+    e.start = start;
+    e.end = end;
+    e.lane = (request_lane ? REQUEST_LANE_OFFSET + (int)(trace % REQUEST_LANE_OFFSET) : lane());
+
+    QMutexLocker lk(&tracer_state.mutex);
+    tracer_state.add(e);
+}
+
+static void write_string(QTextStream &output, const QByteArray &s)
+{
+    output << '"';
+    for (char c: s)
+    {
+        if (c == '"' || c == '\\') output << '\\' << c;
+        else if ((unsigned char)c < 0x20) output << ' ';
+        else output << c;
+    }
+    output << '"';
+}
+
+QByteArray Tracer::toJson()
+{
+    QVector<Event> events;
+    {
+        QMutexLocker lk(&tracer_state.mutex);
+        if (tracer_state.wrapped)
+            events = tracer_state.ring.mid(tracer_state.next) + tracer_state.ring.mid(0, tracer_state.next);
+        else
+            events = tracer_state.ring.mid(0, tracer_state.next);
+    }
+
+    QByteArray result;
+    QTextStream output(&result, QIODevice::WriteOnly);
+    output.setRealNumberNotation(QTextStream::FixedNotation);
+    output.setRealNumberPrecision(3);
+
+    qint64 pid = getpid();
+    QHash<int, QByteArray> lanes;
+
+    output << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    for (const Event &e: events)
+    {
+        if (!first) output << ",";
+        first = false;
+
+        // timestamps are in microseconds
+        output << "{\"name\":";
+        write_string(output, e.name);
+        output << ",\"cat\":\"request\",\"ph\":\"X\",\"pid\":" << pid
+               << ",\"tid\":" << e.lane
+               << ",\"ts\":" << e.start / 1000.0
+               << ",\"dur\":" << (e.end - e.start) / 1000.0
+               << ",\"args\":{\"trace\":" << e.trace;
+        if (!e.url.isEmpty())
+        {
+            output << ",\"url\":";
+            write_string(output, e.url);
+        }
+        output << "}}";
+
+        if (!lanes.contains(e.lane))
+            lanes.insert(e.lane, e.lane >= REQUEST_LANE_OFFSET ?
+                             "request " + QByteArray::number(e.trace) :
+                             "thread " + QByteArray::number(e.lane));
+    }
+
+    // names of the lanes
+    for (auto iter = lanes.constBegin(); iter != lanes.constEnd(); ++iter)
+    {
+        if (!first) output << ",";
+        first = false;
+
+        output << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid
+               << ",\"tid\":" << iter.key() << ",\"args\":{\"name\":";
+        write_string(output, iter.value());
+        output << "}}";
+    }
+
+    output << "]}";
+    output.flush();
+    return result;
+}
+
+void Tracer::clear()
+{
+    QMutexLocker lk(&tracer_state.mutex);
+    tracer_state.ring.fill(Event());
+    tracer_state.next = 0;
+    tracer_state.wrapped = false;
+}
+
+/////////////////////////////////////////////////////////////////
+/// Tracer::Span
+
+Tracer::Span::Span(const char *name):
+    m_trace(current()),
+    m_name(name),
+    m_start(m_trace != 0 ? now() : 0)
+{
+}
+
+void Tracer::Span::next(const char *name)
+{
+    end();
+    m_trace = current();
+    m_name = name;
+    m_start = (m_trace != 0 ? now() : 0);
+}
+
+void Tracer::Span::end()
+{
+    if (m_trace == 0)
+        return;
+
+    record(m_trace, m_name, m_start, now());
+    m_trace = 0;
+}
@@ -0,0 +1,83 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <QByteArray>
+#include <QtGlobal>
+
+/// \brief Tracing of the requests
+///
+/// Each traced request gets an id that is carried by the thread serving
+/// it and by the tasks started for it. Spans of the request phases, such
+/// as dispatch, waiting in queue, computing the response, database work
+/// and sending the response, are recorded into a bounded ring. When the
+/// ring is full, the oldest spans are dropped. Spans can be exported as
+/// Chrome trace event JSON for viewing in a trace viewer. Spans of
+/// waiting in the queue and sending are shown on the lane of the request,
+/// the others on the lane of the thread doing the work. Thread safe.
+///
+/// Tracing is disabled if the ring capacity is set to zero. In this case,
+/// no requests are traced and the spans are not recorded.
+class Tracer
+{
+public:
+    /// \brief Set capacity of the ring in the number of spans, 0 to disable
+    static void setup(int capacity);
+
+    /// \brief Start tracing of the request and make it current in this thread
+    ///
+    /// Returns id of the trace or 0 if tracing is disabled
+    static quint64 begin(const char *url);
+
+    /// \brief Mark the response as ready to be sent
+    static void ready(quint64 trace);
+
+    /// \brief Finish tracing of the request
+    static void end(quint64 trace, bool ok);
+
+    /// \brief Trace served by the current thread, 0 if none
+    static quint64 current();
+    static void setCurrent(quint64 trace);
+
+    /// \brief Monotonic time in nanoseconds, as used for spans
+    static qint64 now();
+
+    /// \brief Record span given by its start and end time
+    static void record(quint64 trace, const char *name, qint64 start, qint64 end,
+                       bool request_lane = false);
+
+    /// \brief Recorded spans in Chrome trace event format
+    static QByteArray toJson();
+
+    static void clear();
+
+public:
+    /// \brief Span of the current trace on the current thread, ended on destruction
+    class Span
+    {
+    public:
+        Span(const char *name);
+        ~Span() { end(); }
+
+        /// \brief End this span and start the next one
+        void next(const char *name);
+        void end();
+
+    protected:
+        quint64 m_trace;
+        const char *m_name;
+        qint64 m_start;
+    };
+
+    /// \brief Makes the trace current in this thread for the lifetime of the scope
+    class Scope
+    {
+    public:
+        Scope(quint64 trace): m_previous(current()) { setCurrent(trace); }
+        ~Scope() { setCurrent(m_previous); }
+
+    protected:
+        quint64 m_previous;
+    };
+};
+
+#endif // TRACER_H
@@ -0,0 +1,116 @@
+#include "microhttpcompressor.h"
+
+#include <QString>
+#include <QStringList>
+
+#include <string.h>
+
+using namespace MicroHTTP;
+
+#define CHUNK_SIZE 16384
+
+Compressor::Compressor(Encoding encoding, int level)
+{
+    memset(&m_stream, 0, sizeof(m_stream));
+    if (encoding == Identity)
+        return;
+
+    // window bits: 15 for zlib format, adding 16 switches to gzip format
+    int window_bits = (encoding == Gzip ? 15 + 16 : 15);
+    m_ok = ( deflateInit2(&m_stream, level, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY) == Z_OK );
+}
+
+Compressor::~Compressor()
+{
+    if (m_ok)
+        deflateEnd(&m_stream);
+}
+
+bool Compressor::process(const char *data, size_t size, int flush, QByteArray &output)
+{
+    if (!m_ok)
+        return false;
+
+    m_stream.next_in = (Bytef*)data;
+    m_stream.avail_in = (uInt)size;
+
+    int ret;
+    do {
+        int offset = output.size();
+        output.resize(offset + CHUNK_SIZE);
+        m_stream.next_out = (Bytef*)(output.data() + offset);
+        m_stream.avail_out = CHUNK_SIZE;
+
+        ret = deflate(&m_stream, flush);
+        output.resize(output.size() - m_stream.avail_out);
+
+        if (ret == Z_STREAM_ERROR)
+        {
+            m_ok = false;
+            return false;
+        }
+    } while (m_stream.avail_out == 0);
+
+    return (flush != Z_FINISH || ret == Z_STREAM_END);
+}
+
+bool Compressor::add(const char *data, size_t size, QByteArray &output)
+{
+    return process(data, size, Z_NO_FLUSH, output);
+}
+
+bool Compressor::finish(QByteArray &output)
+{
+    bool ok = process(NULL, 0, Z_FINISH, output);
+    if (m_ok)
+        deflateEnd(&m_stream);
+    m_ok = false;
+    return ok;
+}
+
+bool Compressor::compress(Encoding encoding, const QByteArray &input, QByteArray &output, int level)
+{
+    Compressor c(encoding, level);
+    output.clear();
+    output.reserve(input.size() / 4 + 64);
+    return c.add(input.constData(), input.size(), output) && c.finish(output);
+}
+
+Compressor::Encoding Compressor::fromAcceptEncoding(const char *header)
+{
+    if (header == NULL)
+        return Identity;
+
+    // encodings with q=0 are not acceptable, gzip is preferred if both are allowed
+    bool gzip = false;
+    bool deflate = false;
+    for (const QString &item: QString::fromLatin1(header).split(',', QString::SkipEmptyParts))
+    {
+        QStringList parts = item.split(';');
+        QString coding = parts[0].trimmed().toLower();
+        bool allowed = true;
+        for (int i=1; i < parts.size(); ++i)
+        {
+            QString p = parts[i].trimmed();
+            if (p.startsWith("q="))
+                allowed = ( p.mid(2).toDouble() > 0 );
+        }
+
+        if (coding == "gzip" || coding == "x-gzip") gzip = allowed;
+        else if (coding == "deflate") deflate = allowed;
+    }
+
+    if (gzip) return Gzip;
+    if (deflate) return Deflate;
+    return Identity;
+}
+
+const char* Compressor::name(Encoding encoding)
+{
+    switch (encoding)
+    {
+    case Gzip: return "gzip";
+    case Deflate: return "deflate";
+    default: return NULL;
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef MICROHTTPCOMPRESSOR_H
+#define MICROHTTPCOMPRESSOR_H
+
+#include <QByteArray>
+
+#include <zlib.h>
+
+namespace MicroHTTP {
+
+/// \brief Streaming compressor for HTTP content encoding
+///
+/// Compresses data in gzip or deflate (zlib) format, as used in
+/// Content-Encoding. Data can be added in chunks, with the output
+/// appended after each chunk. Not thread safe, use one instance per
+/// response.
+class Compressor
+{
+public:
+    enum Encoding { Identity, Gzip, Deflate };
+
+public:
+    explicit Compressor(Encoding encoding, int level = Z_DEFAULT_COMPRESSION);
+    ~Compressor();
+
+    bool add(const char *data, size_t size, QByteArray &output);
+    bool finish(QByteArray &output); ///< Flushes all remaining data, compressor can't be used afterwards
+
+    /// \brief Compress the data in one call
+    static bool compress(Encoding encoding, const QByteArray &input, QByteArray &output,
+                         int level = Z_DEFAULT_COMPRESSION);
+
+    /// \brief Choose the preferred encoding from Accept-Encoding header value
+    static Encoding fromAcceptEncoding(const char *header);
+
+    /// \brief Content-Encoding header value, NULL for Identity
+    static const char* name(Encoding encoding);
+
+protected:
+    bool process(const char *data, size_t size, int flush, QByteArray &output);
+
+protected:
+    z_stream m_stream;
+    bool m_ok = false;
+};
+
+}
+
+#endif // MICROHTTPCOMPRESSOR_H
@@ -1,8 +1,32 @@
 #include "microhttpconnection.h"
 
+#include <unistd.h>
+
 MicroHTTP::Connection::Connection(MicroHTTP::Server *server, MHD_Connection *connection):
     m_server(server),
     m_connection(connection)
 {
 
 }
+
+void MicroHTTP::Connection::setFile(int fd, size_t size)
+{
+    closeFile();
+    m_fd = fd;
+    m_fd_size = size;
+}
+
+int MicroHTTP::Connection::takeFile()
+{
+    int fd = m_fd;
+    m_fd = -1;
+    return fd;
+}
+
+void MicroHTTP::Connection::closeFile()
+{
+    if (m_fd >= 0)
+        close(m_fd);
+    m_fd = -1;
+    m_fd_size = 0;
+}
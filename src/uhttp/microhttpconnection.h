@@ -1,11 +1,12 @@
 #ifndef CONNECTION_H
 #define CONNECTION_H
 
-#include "microhttpserver.h"
 #include <microhttpd.h>
 
 #include <QByteArray>
 
+#include <stdint.h>
+
 namespace MicroHTTP {
 
 class Server;
@@ -13,27 +14,40 @@ class Server;
 class Connection
 {
 public:
-    enum State { Wait, Done, Error, NoInstance };
+    enum State { Wait, Done, Error, Streaming, Timeout, NoInstance };
 
 public:
-    typedef char* keytype;
+    /// Key of the connection in ConnectionStore. Key is composed of
+    /// the slot index and the generation of the slot, allowing to detect
+    /// outdated keys after the slot is reused. Key fits into a pointer
+    /// and is passed to libmicrohttpd callbacks as cls. Zero is not a
+    /// valid key
+    typedef uintptr_t keytype;
 
 public:
+    Connection() {}
     Connection(Server *server, MHD_Connection *connection);
 
     Server* server() { return m_server; }
     QByteArray& data() { return m_data; }
     MHD_Connection* connection() { return m_connection; }
-    State state() { return m_state; }
 
-    void setState(State s) { m_state = s; }
     void setData(QByteArray &data) { m_data = data; }
 
+    /// File used as a response instead of the data. Connection owns the
+    /// descriptor until it is taken by takeFile
+    void setFile(int fd, size_t size);
+    int file() const { return m_fd; }
+    size_t fileSize() const { return m_fd_size; }
+    int takeFile();
+    void closeFile();
+
 protected:
     Server *m_server = NULL;
     QByteArray m_data;
     MHD_Connection *m_connection = NULL;
-    State m_state = Wait;
+    int m_fd = -1;
+    size_t m_fd_size = 0;
 };
 
 }
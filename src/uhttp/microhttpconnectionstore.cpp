@@ -1,86 +1,581 @@
 #include "microhttpconnectionstore.h"
 #include "microhttpconnection.h"
 
+#include <QMutex>
 #include <QMutexLocker>
-#include <QHash>
+#include <QList>
+#include <QWaitCondition>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include <string.h>
+#include <unistd.h>
 
 using namespace MicroHTTP;
 
+// Slot state word: generation in the upper bits, sleeping flag and
+// state in the lower bits
+#define STATE_MASK 0x7u
+#define SLEEPING   0x8u
+#define GEN_SHIFT  4
+
+// Key: generation in the upper bits, slot index in the lower. With 20 bits
+// for generation, key fits into 32-bit pointer
+#define SLOT_BITS  12
+#define MAX_SLOTS  (1u << SLOT_BITS)
+#define GEN_MASK   0xFFFFFu
+
+// Maximal amount of streamed data waiting to be sent. Writer is blocked
+// when the buffer is full
+#define STREAM_BUFFER_SIZE (256*1024)
+
+namespace {
+
+enum SlotState { SlotFree = 0, SlotWait, SlotWriting, SlotDone, SlotError, SlotStreaming, SlotTimeout };
+
+// Response submitted in chunks. Protected by its mutex, key identifies
+// the connection using the stream
+struct Stream
+{
+    QMutex mutex;
+    QWaitCondition drained;
+    Connection::keytype key = 0;
+    QList<QByteArray> chunks;
+    int offset = 0;       ///< sent bytes of the first chunk
+    size_t buffered = 0;  ///< bytes waiting to be sent
+    bool finished = false;
+    bool error = false;
+
+    void reset(Connection::keytype k)
+    {
+        key = k;
+        chunks.clear();
+        offset = 0;
+        buffered = 0;
+        finished = error = false;
+        drained.wakeAll();
+    }
+};
+
+struct Slot
+{
+    std::atomic<uint32_t> word{0};
+    std::atomic<uint64_t> serial{0}; ///< unique for each connection, unlike the key
+    std::atomic<Server*> server{nullptr}; ///< server of the connection, read when scanning all slots
+    Connection connection;
+    Stream stream;
+};
+
+// Lock-free stack of free slots. Head keeps the index of the top slot
+// (plus one, zero for empty stack) and a tag that is increased on every
+// change to avoid ABA problem
+class FreeList
+{
+public:
+    FreeList()
+    {
+        for (uint32_t i=MAX_SLOTS; i > 0; --i)
+            push(i-1);
+    }
+
+    bool pop(uint32_t &index)
+    {
+        uint64_t h = m_head.load(std::memory_order_acquire);
+        for (;;)
+        {
+            uint32_t top = (uint32_t)(h & 0xFFFFFFFFu);
+            if (top == 0)
+                return false;
+
+            uint64_t n = ( ((h >> 32) + 1) << 32 ) | m_next[top-1].load(std::memory_order_relaxed);
+            if (m_head.compare_exchange_weak(h, n, std::memory_order_acq_rel, std::memory_order_acquire))
+            {
+                index = top - 1;
+                return true;
+            }
+        }
+    }
+
+    void push(uint32_t index)
+    {
+        uint64_t h = m_head.load(std::memory_order_acquire);
+        for (;;)
+        {
+            m_next[index].store((uint32_t)(h & 0xFFFFFFFFu), std::memory_order_relaxed);
+            uint64_t n = ( ((h >> 32) + 1) << 32 ) | (index + 1);
+            if (m_head.compare_exchange_weak(h, n, std::memory_order_acq_rel, std::memory_order_acquire))
+                return;
+        }
+    }
+
+protected:
+    std::atomic<uint64_t> m_head{0};
+    std::atomic<uint32_t> m_next[MAX_SLOTS];
+};
+
+}
+
 // static objects to keep the store data
-static Connection::keytype next_key = 0;
-static QMutex mutex;
-static QHash<Connection::keytype, Connection> store_data;
+static Slot slot_array[MAX_SLOTS];
+static FreeList free_slots;
+static std::atomic<uint64_t> last_serial{0};
 
-using namespace MicroHTTP;
+static inline uint32_t slot_index(Connection::keytype key)
+{
+    return (uint32_t)(key & (MAX_SLOTS-1));
+}
+
+static inline uint32_t key_generation(Connection::keytype key)
+{
+    return (uint32_t)(key >> SLOT_BITS) & GEN_MASK;
+}
+
+static inline uint32_t word_state(uint32_t w)
+{
+    return w & STATE_MASK;
+}
+
+// checks whether the word corresponds to the active connection with the key
+static inline bool matches(uint32_t w, Connection::keytype key)
+{
+    return (w >> GEN_SHIFT) == key_generation(key) && word_state(w) != SlotFree;
+}
+
+// returns slot if the key is valid
+static inline Slot* find(Connection::keytype key)
+{
+    if (key == 0) return NULL;
+    return &slot_array[slot_index(key)];
+}
 
 ConnectionStore::ConnectionStore()
 {
 
 }
 
+size_t ConnectionStore::capacity()
+{
+    return MAX_SLOTS;
+}
+
+void ConnectionStore::count(size_t &active, size_t &suspended)
+{
+    active = suspended = 0;
+    for (uint32_t i=0; i < MAX_SLOTS; ++i)
+    {
+        uint32_t w = slot_array[i].word.load(std::memory_order_relaxed);
+        if (word_state(w) == SlotFree) continue;
+        ++active;
+        if (w & SLEEPING) ++suspended;
+    }
+}
+
 Connection::keytype ConnectionStore::next(Server *server, MHD_Connection *connection)
 {
-    QMutexLocker lk(&mutex);
-    next_key += 1;
-    store_data.insert(next_key, Connection(server, connection));
-    return next_key;
+    uint32_t index;
+    if (!free_slots.pop(index))
+        return 0;
+
+    Slot &s = slot_array[index];
+    uint32_t gen = ((s.word.load(std::memory_order_relaxed) >> GEN_SHIFT) + 1) & GEN_MASK;
+    if (gen == 0) gen = 1; // ensures that key is never 0
+
+    // slot is not visible to others before the state is published
+    s.connection = Connection(server, connection);
+    s.server.store(server, std::memory_order_relaxed);
+    s.serial.store(++last_serial, std::memory_order_relaxed);
+    {
+        QMutexLocker lk(&s.stream.mutex);
+        s.stream.reset( ( (Connection::keytype)gen << SLOT_BITS ) | index );
+    }
+
+    s.word.store( (gen << GEN_SHIFT) | SlotWait, std::memory_order_release );
+
+    return ( (Connection::keytype)gen << SLOT_BITS ) | index;
 }
 
 void ConnectionStore::destroy(Connection::keytype k)
 {
-    QMutexLocker lk(&mutex);
-    store_data.remove(k);
+    serverDone(k);
 }
 
 Connection::State ConnectionStore::state(Connection::keytype key, Server *&server, MHD_Connection *&connection)
 {
-    QMutexLocker lk(&mutex);
-    auto iter = store_data.find(key);
-    if (iter == store_data.end())
+    Slot *s = find(key);
+    uint32_t w = (s == NULL ? 0 : s->word.load(std::memory_order_acquire));
+    if (s == NULL || !matches(w, key))
     {
         server = NULL;
         connection = NULL;
         return Connection::NoInstance;
     }
 
-    server = iter->server();
-    connection = iter->connection();
-    return iter->state();
+    // slot is released only by the network thread serving the connection
+    server = s->connection.server();
+    connection = s->connection.connection();
+
+    switch (word_state(w))
+    {
+    case SlotDone: return Connection::Done;
+    case SlotError: return Connection::Error;
+    case SlotStreaming: return Connection::Streaming;
+    case SlotTimeout: return Connection::Timeout;
+    default: return Connection::Wait;
+    }
+}
+
+// claims the slot for writing the response
+static bool claim(Slot *s, Connection::keytype key)
+{
+    if (s == NULL) return false;
+
+    uint32_t w = s->word.load(std::memory_order_acquire);
+    do {
+        if (!matches(w, key) || word_state(w) != SlotWait)
+            return false;
+    } while ( !s->word.compare_exchange_weak(w, (w & ~STATE_MASK) | SlotWriting,
+                                             std::memory_order_acq_rel, std::memory_order_acquire) );
+
+    return true;
+}
+
+// publishes the response written into the claimed slot. If the
+// connection was suspended, it has to be resumed
+static void publish(Slot *s, uint32_t state)
+{
+    Server *server = s->connection.server();
+    MHD_Connection *connection = s->connection.connection();
+
+    uint32_t w = s->word.load(std::memory_order_relaxed);
+    uint32_t n;
+    do {
+        n = (w & ~(STATE_MASK | SLEEPING)) | state;
+    } while ( !s->word.compare_exchange_weak(w, n, std::memory_order_acq_rel, std::memory_order_relaxed) );
+
+    if (w & SLEEPING)
+        server->resume(connection);
 }
 
 void ConnectionStore::setData(Connection::keytype key, QByteArray &data, bool error)
 {
-    QMutexLocker lk(&mutex);
-    auto iter = store_data.find(key);
-    if (iter == store_data.end())
+    Slot *s = find(key);
+    if (!claim(s, key))
+        return;
+
+    s->connection.setData(data);
+    publish(s, error ? SlotError : SlotDone);
+}
+
+bool ConnectionStore::setFile(Connection::keytype key, int fd, size_t size)
+{
+    Slot *s = find(key);
+    if (!claim(s, key))
+    {
+        close(fd);
+        return false;
+    }
+
+    s->connection.setFile(fd, size);
+    publish(s, SlotDone);
+    return true;
+}
+
+// wakes up the connection if it sleeps while waiting for the data
+static void wake(Slot *s, Connection::keytype key)
+{
+    uint32_t w = s->word.load(std::memory_order_acquire);
+    while ( matches(w, key) && (w & SLEEPING) )
+    {
+        if (s->word.compare_exchange_weak(w, w & ~SLEEPING,
+                                          std::memory_order_acq_rel, std::memory_order_acquire))
+        {
+            s->connection.server()->resume(s->connection.connection());
+            return;
+        }
+    }
+}
+
+// switches waiting connection to streaming, has to be called with
+// the stream locked
+static bool start_streaming(Slot *s, Connection::keytype key)
+{
+    uint32_t w = s->word.load(std::memory_order_acquire);
+    for (;;)
+    {
+        if (!matches(w, key)) return false;
+        if (word_state(w) == SlotStreaming) return true;
+        if (word_state(w) != SlotWait) return false;
+
+        if (s->word.compare_exchange_weak(w, (w & ~STATE_MASK) | SlotStreaming,
+                                          std::memory_order_acq_rel, std::memory_order_acquire))
+            return true;
+    }
+}
+
+bool ConnectionStore::append(Connection::keytype key, const QByteArray &data)
+{
+    Slot *s = find(key);
+    if (s == NULL) return false;
+
+    {
+        Stream &st = s->stream;
+        QMutexLocker lk(&st.mutex);
+        if (st.key != key || !start_streaming(s, key))
+            return false;
+
+        // bounded buffer: wait for the network thread to send the data
+        while (st.key == key && st.buffered >= STREAM_BUFFER_SIZE)
+            st.drained.wait(&st.mutex);
+
+        if (st.key != key)
+            return false;
+
+        if (!data.isEmpty())
+        {
+            st.chunks.append(data);
+            st.buffered += data.size();
+        }
+    }
+
+    wake(s, key);
+    return true;
+}
+
+void ConnectionStore::finish(Connection::keytype key, bool error)
+{
+    Slot *s = find(key);
+    if (s == NULL) return;
+
+    {
+        Stream &st = s->stream;
+        QMutexLocker lk(&st.mutex);
+        if (st.key != key || !start_streaming(s, key))
+            return;
+
+        st.finished = true;
+        st.error = error;
+    }
+
+    wake(s, key);
+}
+
+uint64_t ConnectionStore::serial(Connection::keytype key)
+{
+    Slot *s = find(key);
+    if (s == NULL || !matches(s->word.load(std::memory_order_acquire), key))
+        return 0;
+    return s->serial.load(std::memory_order_relaxed);
+}
+
+bool ConnectionStore::expire(Connection::keytype key, uint64_t serial)
+{
+    // key generation wraps around on busy slots, serial ensures that the
+    // slot still serves the same connection. Workers submitting the
+    // response later fail to claim the slot
+    Slot *s = find(key);
+    if (s == NULL || s->serial.load(std::memory_order_acquire) != serial || !claim(s, key))
+        return false;
+
+    publish(s, SlotTimeout);
+    return true;
+}
+
+ssize_t ConnectionStore::readStream(Connection::keytype key, char *buf, size_t max)
+{
+    Slot *s = find(key);
+    if (s == NULL) return MHD_CONTENT_READER_END_WITH_ERROR;
+
+    Stream &st = s->stream;
+    QMutexLocker lk(&st.mutex);
+    if (st.key != key)
+        return MHD_CONTENT_READER_END_WITH_ERROR;
+
+    size_t n = 0;
+    while (n < max && !st.chunks.isEmpty())
+    {
+        const QByteArray &c = st.chunks.first();
+        size_t k = std::min(max - n, (size_t)(c.size() - st.offset));
+        memcpy(buf + n, c.constData() + st.offset, k);
+        n += k;
+        st.offset += k;
+        if (st.offset >= c.size())
+        {
+            st.chunks.removeFirst();
+            st.offset = 0;
+        }
+    }
+
+    if (n > 0)
+    {
+        st.buffered -= n;
+        st.drained.wakeAll();
+        return n;
+    }
+
+    if (st.finished)
+        return st.error ? MHD_CONTENT_READER_END_WITH_ERROR : MHD_CONTENT_READER_END_OF_STREAM;
+
+    return 0;
+}
+
+void ConnectionStore::suspend(Connection::keytype key)
+{
+    Slot *s = find(key);
+    if (s == NULL) return;
+
+    uint32_t w = s->word.load(std::memory_order_acquire);
+    if (!matches(w, key))
         return;
 
-    iter->setData(data);
-    if (error)
-        iter->setState(Connection::Error);
-    else
-        iter->setState(Connection::Done);
+    Server *server = s->connection.server();
+    MHD_Connection *connection = s->connection.connection();
 
-    iter->server()->resume( iter->connection() );
+    // connection is marked as sleeping while the server holds its lock, so
+    // it cannot miss the connection when resuming all of them on shutdown
+    server->suspend(connection, [&]() {
+        // mark connection as sleeping. If the data was submitted while
+        // suspending, nobody will wake the connection up - resume it here
+        for (;;)
+        {
+            w = s->word.load(std::memory_order_acquire);
+            uint32_t st = word_state(w);
+            if (matches(w, key) && st == SlotStreaming)
+            {
+                // streamed data is appended with the stream locked, only
+                // the sleeping flag can change while holding the lock
+                QMutexLocker lk(&s->stream.mutex);
+                if (!s->stream.chunks.isEmpty() || s->stream.finished)
+                {
+                    server->resume(connection);
+                    return;
+                }
+
+                w = s->word.load(std::memory_order_acquire);
+                while (matches(w, key))
+                    if (s->word.compare_exchange_weak(w, w | SLEEPING,
+                                                      std::memory_order_acq_rel, std::memory_order_acquire))
+                        return;
+
+                server->resume(connection);
+                return;
+            }
+            else if (matches(w, key) && (st == SlotWait || st == SlotWriting))
+            {
+                if (s->word.compare_exchange_weak(w, w | SLEEPING,
+                                                  std::memory_order_acq_rel, std::memory_order_acquire))
+                    return;
+            }
+            else
+            {
+                server->resume(connection);
+                return;
+            }
+        }
+    });
+}
+
+void ConnectionStore::resumeAll(Server *server)
+{
+    for (uint32_t i=0; i < MAX_SLOTS; ++i)
+    {
+        Slot &s = slot_array[i];
+        // slot can be reassigned by other network threads while scanning,
+        // only the atomic fields are read before the sleeping flag is
+        // cleared. Sleeping connection is not released until it is resumed
+        uint32_t w = s.word.load(std::memory_order_acquire);
+        while ( (w & SLEEPING) && s.server.load(std::memory_order_relaxed) == server )
+        {
+            if (s.word.compare_exchange_weak(w, w & ~SLEEPING,
+                                             std::memory_order_acq_rel, std::memory_order_acquire))
+            {
+                server->resume(s.connection.connection());
+                break;
+            }
+        }
+    }
 }
 
 bool ConnectionStore::dataToSend(Connection::keytype key, QByteArray &data)
 {
-    QMutexLocker lk(&mutex);
-    auto iter = store_data.find(key);
-    if ( iter == store_data.end() ||
-         (iter->state()!=Connection::Done && iter->state()!=Connection::Error) )
+    Slot *s = find(key);
+    if (s == NULL) return false;
+
+    uint32_t w = s->word.load(std::memory_order_acquire);
+    if ( !matches(w, key) ||
+         (word_state(w) != SlotDone && word_state(w) != SlotError) )
         return false;
 
-    data = iter->data();
+    data = s->connection.data();
+    return true;
+}
+
+// returns slot with the submitted response
+static Slot* ready(Connection::keytype key)
+{
+    Slot *s = find(key);
+    if (s == NULL) return NULL;
+
+    uint32_t w = s->word.load(std::memory_order_acquire);
+    if ( !matches(w, key) || word_state(w) != SlotDone )
+        return NULL;
+
+    return s;
+}
+
+int ConnectionStore::takeFileToSend(Connection::keytype key, size_t &size)
+{
+    // only the network thread serving the connection accesses the
+    // file after the response is published
+    Slot *s = ready(key);
+    if (s == NULL) return -1;
+
+    size = s->connection.fileSize();
+    return s->connection.takeFile();
+}
+
+bool ConnectionStore::readFile(Connection::keytype key, uint64_t pos, char *buf, size_t max, ssize_t &nread)
+{
+    Slot *s = ready(key);
+    if (s == NULL || s->connection.file() < 0) return false;
+
+    nread = pread(s->connection.file(), buf, max, pos);
     return true;
 }
 
 void ConnectionStore::serverDone(Connection::keytype key)
 {
-    QMutexLocker lk(&mutex);
-    auto iter = store_data.find(key);
-    if (iter == store_data.end()) return;
+    Slot *s = find(key);
+    if (s == NULL) return;
+
+    // wait for the worker if it is writing the data
+    uint32_t w = s->word.load(std::memory_order_acquire);
+    for (;;)
+    {
+        if (!matches(w, key))
+            return;
+
+        if (word_state(w) == SlotWriting)
+        {
+            std::this_thread::yield();
+            w = s->word.load(std::memory_order_acquire);
+            continue;
+        }
+
+        if (s->word.compare_exchange_weak(w, (w & ~(STATE_MASK | SLEEPING)) | SlotFree,
+                                          std::memory_order_acq_rel, std::memory_order_acquire))
+            break;
+    }
+
+    {
+        // wakes up the writer if it waits for the buffer to drain
+        QMutexLocker lk(&s->stream.mutex);
+        s->stream.reset(0);
+    }
 
-    store_data.remove(key);
+    s->connection.closeFile();
+    s->connection = Connection();
+    s->server.store(nullptr, std::memory_order_relaxed);
+    free_slots.push(slot_index(key));
 }
@@ -10,19 +10,88 @@ namespace MicroHTTP {
 
 class Server;
 
+/// \brief Store of active connections
+///
+/// Connections are kept in the preallocated array of slots. State of
+/// each slot is kept in a single atomic word together with the slot
+/// generation, allowing to change the state without locking. The
+/// network threads and the workers submitting the data do not block
+/// each other.
 class ConnectionStore
 {
 public:
+    /// \brief Allocates slot for the connection, returns 0 if all slots are in use
     static Connection::keytype next(Server *server, MHD_Connection *connection);
     static void destroy(Connection::keytype);
 
     static Connection::State state(Connection::keytype key, Server* &server, MHD_Connection* &connection);
 
+    /// \brief Submit the data and wake up the connection if it is suspended
     static void setData(Connection::keytype key, QByteArray &data, bool error);
 
+    /// \brief Submit the file as a response, store takes ownership of the descriptor
+    ///
+    /// Returns false if the connection is gone, the descriptor is closed then
+    static bool setFile(Connection::keytype key, int fd, size_t size);
+
+    /// \brief Append a chunk of the streamed response
+    ///
+    /// Response is sent in chunks as they are appended. Blocks while the
+    /// buffer of the stream is full. Returns false if the connection is gone
+    static bool append(Connection::keytype key, const QByteArray &data);
+
+    /// \brief Finish the streamed response
+    static void finish(Connection::keytype key, bool error);
+
+    /// \brief Serial number of the connection, 0 if the connection is gone
+    ///
+    /// Unlike the key, serial is never reused by other connections
+    static uint64_t serial(Connection::keytype key);
+
+    /// \brief Time out the connection waiting for the response
+    ///
+    /// Only connections that have not received any response data are
+    /// timed out. Data submitted later is ignored. Connection is given by
+    /// its key and serial. Returns true if the connection was timed out
+    static bool expire(Connection::keytype key, uint64_t serial);
+
+    /// \brief Read streamed data, called by the network thread
+    ///
+    /// Returns the number of bytes read, 0 if there is no data available
+    /// yet, or libmicrohttpd end of stream and error codes
+    static ssize_t readStream(Connection::keytype key, char *buf, size_t max);
+
+    /// \brief Suspend the connection while waiting for the data
+    ///
+    /// Called from the access handler or content reader of libmicrohttpd.
+    /// If the data was submitted while the connection was being suspended,
+    /// the connection is resumed immediately
+    static void suspend(Connection::keytype key);
+
+    /// \brief Resume all suspended connections of the server, used on shutdown
+    static void resumeAll(Server *server);
+
     static bool dataToSend(Connection::keytype key, QByteArray &data);
+
+    /// \brief Take the response file if it was submitted, returns -1 otherwise
+    ///
+    /// Caller becomes the owner of the file descriptor
+    static int takeFileToSend(Connection::keytype key, size_t &size);
+
+    /// \brief Read the response file at the given offset
+    ///
+    /// Returns false if the response is not given by a file. Otherwise,
+    /// nread is set to the number of read bytes or -1 on error
+    static bool readFile(Connection::keytype key, uint64_t pos, char *buf, size_t max, ssize_t &nread);
     static void serverDone(Connection::keytype key);
 
+    static size_t capacity(); ///< Maximal number of connections
+
+    /// \brief Count connections being served and the suspended ones among them
+    ///
+    /// Scans all slots without locking, the counts are approximate
+    static void count(size_t &active, size_t &suspended);
+
 protected:
     ConnectionStore();
 
@@ -7,12 +7,17 @@
 #include <algorithm>
 #include <functional>
 #include <iostream>
+#include <thread>
 
 #include <string.h>
+#include <unistd.h>
+#include <errno.h>
 #include <arpa/inet.h>
 #include <sys/types.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 
 //#define DEBUG_CONNECTIONS
 
@@ -44,12 +49,28 @@ static ssize_t content_reader_callback (void *cls, uint64_t pos, char *buf, size
     if (server == NULL || state == MicroHTTP::Connection::NoInstance || !(*server))
         return MHD_CONTENT_READER_END_WITH_ERROR;
 
+    if ( state == MicroHTTP::Connection::Streaming )
+    {
+        ssize_t n = MicroHTTP::ConnectionStore::readStream(key, buf, max);
+        if (n == 0)
+            MicroHTTP::ConnectionStore::suspend(key);
+        return n;
+    }
+
     if ( state == MicroHTTP::Connection::Wait )
     {
-        server->suspend(connection);
+        MicroHTTP::ConnectionStore::suspend(key);
         return 0;
     }
 
+    ssize_t nread;
+    if ( MicroHTTP::ConnectionStore::readFile(key, pos, buf, max, nread) )
+    {
+        if (nread < 0) return MHD_CONTENT_READER_END_WITH_ERROR;
+        if (nread == 0) return MHD_CONTENT_READER_END_OF_STREAM;
+        return nread;
+    }
+
     QByteArray data;
     if ( !MicroHTTP::ConnectionStore::dataToSend(key, data) )
         return MHD_CONTENT_READER_END_WITH_ERROR;
@@ -65,34 +86,272 @@ static ssize_t content_reader_callback (void *cls, uint64_t pos, char *buf, size
     return tosend;
 }
 
+static int copy_header(void *cls, enum MHD_ValueKind /*kind*/, const char *key, const char *value)
+{
+    MHD_add_response_header((struct MHD_Response *)cls, key, value);
+    return MHD_YES;
+}
+
+#if MHD_VERSION >= 0x00097300
+static void buffer_free_callback(void *cls)
+{
+    delete (QByteArray*)cls;
+}
+#endif
+
+// Creates response directly from the data if it is available
+// already. Headers set by the service are copied from the callback
+// response. Returns NULL if the data is not ready
+static struct MHD_Response* direct_response(MicroHTTP::Connection::keytype key,
+                                            struct MHD_Response *callback_response)
+{
+    MicroHTTP::Server *server;
+    MHD_Connection *connection;
+    MicroHTTP::Connection::State state = MicroHTTP::ConnectionStore::state(key, server, connection);
+    if (state != MicroHTTP::Connection::Done && state != MicroHTTP::Connection::Error)
+        return NULL;
+
+    // files are sent by the kernel using sendfile. Descriptor is closed
+    // by libmicrohttpd when the response is destroyed
+    size_t fsize;
+    int fd = MicroHTTP::ConnectionStore::takeFileToSend(key, fsize);
+    if (fd >= 0)
+    {
+        struct MHD_Response *response = MHD_create_response_from_fd(fsize, fd);
+        if (response == NULL)
+            close(fd);
+        else
+            MHD_get_response_headers(callback_response, copy_header, response);
+        return response;
+    }
+
+    QByteArray *data = new QByteArray;
+    if ( !MicroHTTP::ConnectionStore::dataToSend(key, *data) )
+    {
+        delete data;
+        return NULL;
+    }
+
+#if MHD_VERSION >= 0x00097300
+    // buffer is owned by QByteArray and released when response is destroyed
+    struct MHD_Response *response =
+            MHD_create_response_from_buffer_with_free_callback_cls(data->size(), data->constData(),
+                                                                   buffer_free_callback, data);
+    if (response == NULL)
+        delete data;
+#else
+    struct MHD_Response *response =
+            MHD_create_response_from_buffer(data->size(), (void*)data->constData(),
+                                            MHD_RESPMEM_MUST_COPY);
+    delete data;
+#endif
+
+    if (response != NULL)
+        MHD_get_response_headers(callback_response, copy_header, response);
+
+    return response;
+}
+
+// Context of the request kept over several calls of answer_to_connection.
+// Used for POST requests to collect the body, for traced requests and for
+// the responses that are queued when their data is ready
+struct Request
+{
+    QByteArray data;
+    bool too_large = false;
+    uint64_t trace = 0;
+
+    // response waiting for the data, keeps the connection slot
+    struct MHD_Response *deferred = NULL;
+    MicroHTTP::Connection::keytype key = 0;
+    unsigned int status = 0;
+};
+
+static int queue_text_response(struct MHD_Connection *connection, unsigned int status, const char *txt)
+{
+    struct MHD_Response *response =
+            MHD_create_response_from_buffer(strlen(txt), (void*)txt, MHD_RESPMEM_PERSISTENT);
+    int ret = MHD_queue_response (connection, status, response);
+    MHD_destroy_response (response);
+    return ret;
+}
+
+static void request_completed(void *cls, struct MHD_Connection */*connection*/,
+                              void **con_cls, enum MHD_RequestTerminationCode toe)
+{
+    MicroHTTP::Server *server = (MicroHTTP::Server*)cls;
+    Request *request = (Request*)*con_cls;
+    if (request == NULL)
+        return;
+
+    if (request->trace != 0)
+        server->service()->requestCompleted(request->trace, toe == MHD_REQUEST_TERMINATED_COMPLETED_OK);
+
+    // releases the connection slot if the response was not queued
+    if (request->deferred != NULL)
+        MHD_destroy_response(request->deferred);
+
+    delete request;
+    *con_cls = NULL;
+}
+
+// Queues the response as it becomes ready. Called when the connection
+// waiting for the data is resumed
+static int queue_deferred(MicroHTTP::Server *server, struct MHD_Connection *connection,
+                          Request *request)
+{
+    MicroHTTP::Server *s;
+    MHD_Connection *c;
+    MicroHTTP::Connection::State state = MicroHTTP::ConnectionStore::state(request->key, s, c);
+
+    if (state == MicroHTTP::Connection::Wait && *server)
+    {
+        MicroHTTP::ConnectionStore::suspend(request->key);
+        return MHD_YES;
+    }
+
+    struct MHD_Response *response = request->deferred;
+    request->deferred = NULL;
+
+    if (state == MicroHTTP::Connection::Wait || state == MicroHTTP::Connection::NoInstance)
+    {
+        MHD_destroy_response(response);
+        return queue_text_response(connection, MHD_HTTP_SERVICE_UNAVAILABLE, "Server is shutting down");
+    }
+
+    // headers set by the service describe the response that did not arrive
+    if (state == MicroHTTP::Connection::Timeout)
+    {
+        MHD_destroy_response(response);
+        return queue_text_response(connection, MHD_HTTP_GATEWAY_TIMEOUT, "Request timed out");
+    }
+
+    // streamed responses are sent through the content reader
+    struct MHD_Response *direct = direct_response(request->key, response);
+    if (direct != NULL)
+    {
+        MHD_destroy_response (response);
+        response = direct;
+    }
+
+    int ret = MHD_queue_response (connection, request->status, response);
+    MHD_destroy_response (response);
+    return ret;
+}
+
 static int answer_to_connection (void *cls, struct MHD_Connection *connection,
                                  const char *url, const char *method,
-                                 const char */*version*/, const char */*upload_data*/,
-                                 size_t */*upload_data_size*/, void **/*con_cls*/)
+                                 const char */*version*/, const char *upload_data,
+                                 size_t *upload_data_size, void **con_cls)
 {
     //std::cout << "answer:" << url << " / " << method << " / version " << version  << std::endl;
 
-    if (strcmp("GET", method))
+    bool post = (strcmp("POST", method) == 0);
+    if (strcmp("GET", method) && !post)
     {
         //std::cout << method << " -> not GET" << std::endl;
         return MHD_NO;
     }
 
-    struct MHD_Response *response;
     MicroHTTP::Server *server = (MicroHTTP::Server*)cls;
+
+    // request was served already and is waiting for the response
+    Request *request = (Request*)*con_cls;
+    if (request != NULL && request->deferred != NULL)
+        return queue_deferred(server, connection, request);
+
+    // POST body arrives in chunks, the request is served after the last one
+    if (post)
+    {
+        if (request == NULL)
+        {
+            *con_cls = new Request;
+            return MHD_YES;
+        }
+
+        if (*upload_data_size > 0)
+        {
+            if (request->data.size() + *upload_data_size > server->maxUploadSize())
+            {
+                request->too_large = true;
+                request->data.clear();
+            }
+            else if (!request->too_large)
+                request->data.append(upload_data, *upload_data_size);
+
+            *upload_data_size = 0;
+            return MHD_YES;
+        }
+
+        if (request->too_large)
+            return queue_text_response(connection, MHD_HTTP_REQUEST_ENTITY_TOO_LARGE, "Request is too large");
+    }
+
+    struct MHD_Response *response;
     MicroHTTP::Connection::keytype
             connection_id = MicroHTTP::ConnectionStore::next(server, connection);
 
     int ret;
 
+    if (connection_id == 0)
+    {
+        // all connection slots are in use
+        return queue_text_response(connection, MHD_HTTP_SERVICE_UNAVAILABLE, "Server is busy");
+    }
+
+    // traced requests keep the context until the response is sent
+    uint64_t trace = server->service()->requestStarted(url);
+    if (trace != 0)
+    {
+        if (request == NULL)
+        {
+            request = new Request;
+            *con_cls = request;
+        }
+        request->trace = trace;
+    }
+
     response =
             MHD_create_response_from_callback(-1, 1024*1024,
                                               content_reader_callback,
-                                              connection_id,
+                                              (void*)connection_id,
                                               content_reader_free_callback);
 
     unsigned int status_code =
-            server->service()->service(url, connection, response, connection_id);
+            post ?
+                server->service()->servicePost(url, request->data, connection, response, connection_id) :
+                server->service()->service(url, connection, response, connection_id);
+
+    // Response is ready if it was found in cache or if there was an error in
+    // request. In this case, it is sent directly without the content reader
+    // callback and suspending the connection. Destroying the callback response
+    // releases the connection data in the store
+    struct MHD_Response *direct = direct_response(connection_id, response);
+    if (direct != NULL)
+    {
+        MHD_destroy_response (response);
+        response = direct;
+    }
+    else
+    {
+        // Response is queued when the data is ready or the request times
+        // out, allowing to answer with the timeout error. Meanwhile, the
+        // connection is suspended
+        MicroHTTP::Server *s;
+        MHD_Connection *c;
+        if ( MicroHTTP::ConnectionStore::state(connection_id, s, c) == MicroHTTP::Connection::Wait )
+        {
+            if (request == NULL)
+            {
+                request = new Request;
+                *con_cls = request;
+            }
+            request->deferred = response;
+            request->key = connection_id;
+            request->status = status_code;
+            return queue_deferred(server, connection, request);
+        }
+    }
 
     ret = MHD_queue_response (connection, status_code, response);
     MHD_destroy_response (response);
@@ -116,11 +375,13 @@ void* uri_logger(void * cls, const char * uri, struct MHD_Connection */*con*/)
 ///
 
 MicroHTTP::Server::Server(ServiceBase *service,
-                          unsigned int port, const char *addrstring) :
+                          unsigned int port, const char *addrstring,
+                          const ServerOptions &options) :
     #ifdef HAS_MICRO_HTTP_CLEANUP_TIMER
     QObject(),
     #endif
-    m_service(service)
+    m_service(service),
+    m_max_upload_size(options.max_upload_size)
 {
     // Listen on specified address only
     struct sockaddr_in server_address;
@@ -140,14 +401,124 @@ MicroHTTP::Server::Server(ServiceBase *service,
         }
     }
 
-    m_daemon = MHD_start_daemon (MHD_USE_SELECT_INTERNALLY | MHD_USE_SUSPEND_RESUME,
-                                 port /*ignered since its in SOCK_ADDR OPTION*/,
+    // with SO_REUSEPORT, the kernel distributes incoming connections
+    // between the processes listening on the same port
+#if MHD_VERSION >= 0x00093900
+    MHD_OptionItem address[] = {
+        { MHD_OPTION_SOCK_ADDR, 0, &server_address },
+        { MHD_OPTION_LISTENING_ADDRESS_REUSE, (options.reuse_port ? 1 : 0), NULL },
+        { MHD_OPTION_END, 0, NULL }
+    };
+#else
+    if (options.reuse_port)
+    {
+        std::cerr << "Sharing the port between processes is not supported by libmicrohttpd" << std::endl;
+        m_state = false;
+        return;
+    }
+
+    MHD_OptionItem address[] = {
+        { MHD_OPTION_SOCK_ADDR, 0, &server_address },
+        { MHD_OPTION_END, 0, NULL }
+    };
+#endif
+
+    startDaemon(options, address);
+}
+
+MicroHTTP::Server::Server(ServiceBase *service,
+                          const char *socket_path, unsigned int permissions,
+                          const ServerOptions &options) :
+    #ifdef HAS_MICRO_HTTP_CLEANUP_TIMER
+    QObject(),
+    #endif
+    m_service(service),
+    m_max_upload_size(options.max_upload_size)
+{
+    struct sockaddr_un server_address;
+
+    memset (&server_address, 0, sizeof(server_address));
+    server_address.sun_family = AF_UNIX;
+    if (socket_path == NULL || strlen(socket_path) >= sizeof(server_address.sun_path))
+    {
+        std::cerr << "Wrong socket path" << std::endl;
+        m_state = false;
+        return;
+    }
+    strcpy(server_address.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        std::cerr << "Failed to create socket: " << strerror(errno) << std::endl;
+        m_state = false;
+        return;
+    }
+
+    // socket left from the previous run is removed. Access to the socket
+    // is controlled by filesystem permissions which are set before
+    // accepting connections
+    unlink(socket_path);
+    if ( bind(fd, (struct sockaddr*)&server_address, sizeof(server_address)) != 0 ||
+         chmod(socket_path, permissions) != 0 ||
+         listen(fd, SOMAXCONN) != 0 )
+    {
+        std::cerr << "Failed to setup socket " << socket_path << ": " << strerror(errno) << std::endl;
+        close(fd);
+        unlink(socket_path);
+        m_state = false;
+        return;
+    }
+
+    m_socket_path = socket_path;
+
+    // listening socket is closed by libmicrohttpd on stop
+    MHD_OptionItem address[] = {
+        { MHD_OPTION_LISTEN_SOCKET, fd, NULL },
+        { MHD_OPTION_END, 0, NULL }
+    };
+
+    // once handed to libmicrohttpd, the socket may be closed by it on
+    // failure as well and is not closed here to avoid closing a reused
+    // descriptor. Only the socket file is removed
+    startDaemon(options, address);
+    if (m_daemon == NULL)
+    {
+        unlink(socket_path);
+        m_socket_path.clear();
+    }
+}
+
+void MicroHTTP::Server::startDaemon(const ServerOptions &options, MHD_OptionItem *address)
+{
+    // Use epoll if available. It scales with the number of connections
+    // and suspended connections are not polled. Fall back to poll and
+    // select if needed
+    unsigned int flags = MHD_USE_SUSPEND_RESUME;
+#if MHD_VERSION >= 0x00095100
+    if (MHD_is_feature_supported(MHD_FEATURE_EPOLL) == MHD_YES)
+        flags |= MHD_USE_EPOLL_INTERNALLY;
+    else if (MHD_is_feature_supported(MHD_FEATURE_POLL) == MHD_YES)
+        flags |= MHD_USE_POLL_INTERNALLY;
+    else
+#endif
+        flags |= MHD_USE_SELECT_INTERNALLY;
+
+    // Each thread in the pool runs its own event loop and accepts
+    // connections from the shared listening socket
+    unsigned int threads = options.threads;
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    m_daemon = MHD_start_daemon (flags,
+                                 0 /*ignored since the address is given in options*/,
                                  NULL, NULL,
                                  answer_to_connection, this,
-                                 MHD_OPTION_SOCK_ADDR, &server_address,
-                                 MHD_OPTION_CONNECTION_LIMIT, 100,
-                                 MHD_OPTION_CONNECTION_TIMEOUT, 600, // seconds
-                                 //MHD_OPTION_NOTIFY_COMPLETED, request_completed, this,
+                                 MHD_OPTION_ARRAY, address,
+                                 MHD_OPTION_THREAD_POOL_SIZE, (threads > 1 ? threads : 0),
+                                 MHD_OPTION_CONNECTION_LIMIT, options.connection_limit,
+                                 MHD_OPTION_CONNECTION_TIMEOUT, options.connection_timeout, // seconds
+                                 MHD_OPTION_NOTIFY_COMPLETED, request_completed, this,
                                  MHD_OPTION_URI_LOG_CALLBACK, uri_logger, this,
                                  MHD_OPTION_END);
     if (m_daemon == NULL)
@@ -163,30 +534,33 @@ MicroHTTP::Server::Server(ServiceBase *service,
 
 MicroHTTP::Server::~Server()
 {
-    std::lock_guard<std::mutex> _lk(m_mutex);
+    if (m_daemon == NULL) return;
 
-    m_state = false; // indicates that we are going to shutdown
-    for (MHD_Connection *conn: m_connections_sleeping)
-        MHD_resume_connection(conn);
-    m_connections_sleeping.clear();
+    // sleeping connections are woken up and are not suspended again
+    ConnectionStore::resumeAll(this);
+    {
+        QWriteLocker lk(&m_lock);
+        m_state = false; // indicates that we are going to shutdown
+    }
+    ConnectionStore::resumeAll(this);
 
     MHD_stop_daemon (m_daemon);
+
+    if (!m_socket_path.empty())
+        unlink(m_socket_path.c_str());
 }
 
 void MicroHTTP::Server::cleanup()
 {
-    std::lock_guard<std::mutex> _lk(m_mutex);
-
-    if (!m_state) return;
-
-    for (MHD_Connection *conn: m_connections_sleeping)
     {
-        MHD_resume_connection(conn);
+        QReadLocker lk(&m_lock);
+        if (!m_state) return;
+    }
+
 #ifdef DEBUG_CONNECTIONS
-        std::cout << "Resume by timer: " << (size_t)conn << std::endl;
+    std::cout << "Resume by timer" << std::endl;
 #endif
-    }
-    m_connections_sleeping.clear();
+    ConnectionStore::resumeAll(this);
 }
 
 
@@ -198,36 +572,27 @@ void MicroHTTP::Server::timerEvent(QTimerEvent */*event*/)
 #endif
 
 
-void MicroHTTP::Server::suspend(MHD_Connection *conn)
+bool MicroHTTP::Server::suspend(MHD_Connection *conn, const std::function<void()> &suspended)
 {
-    std::lock_guard<std::mutex> _lk(m_mutex);
+    QReadLocker lk(&m_lock);
 
-    if (!m_state) return;
+    if (!m_state) return false;
 
     MHD_suspend_connection(conn);
-    m_connections_sleeping.insert(conn);
+    if (suspended) suspended();
 
 #ifdef DEBUG_CONNECTIONS
     std::cout << "Suspend: " << (size_t)conn << std::endl;
 #endif
+
+    return true;
 }
 
 void MicroHTTP::Server::resume(MHD_Connection *conn)
 {
-    std::lock_guard<std::mutex> _lk(m_mutex);
-
-
-#ifdef DEBUG_CONNECTIONS
-    std::cout << "Called to resume: " << (size_t)conn << std::endl;
-#endif
-
-    if (!m_state || m_connections_sleeping.count(conn) == 0) return;
-
     MHD_resume_connection(conn);
 
 #ifdef DEBUG_CONNECTIONS
     std::cout << "Resumed: " << (size_t)conn << std::endl;
 #endif
-
-    m_connections_sleeping.erase(conn);
 }
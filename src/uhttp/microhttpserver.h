@@ -2,8 +2,11 @@
 #define MICROHTTPSERVER_H
 
 #include <microhttpd.h>
-#include <mutex>
-#include <set>
+
+#include <QReadWriteLock>
+
+#include <functional>
+#include <string>
 
 //#define HAS_MICRO_HTTP_CLEANUP_TIMER
 
@@ -15,6 +18,16 @@ namespace MicroHTTP {
 
 class ServiceBase;
 
+/// \brief Parameters of HTTP server
+struct ServerOptions
+{
+    unsigned int threads = 0;              ///< number of network threads, 0 for one thread per CPU
+    unsigned int connection_limit = 100;   ///< maximal number of concurrent connections
+    unsigned int connection_timeout = 600; ///< inactivity timeout in seconds
+    size_t max_upload_size = 1024*1024;    ///< maximal size of POST request body in bytes
+    bool reuse_port = false;               ///< allow several processes to listen on the same TCP port (SO_REUSEPORT)
+};
+
 class Server
         #ifdef HAS_MICRO_HTTP_CLEANUP_TIMER
         : public QObject
@@ -31,18 +44,38 @@ public:
     /// \param service object providing service to connections
     /// \param port server listening on the port
     /// \param address server binding to this interface given in x.x.x.x form. If NULL, server binds to all interfaces
-    /// \param parent
+    /// \param options server parameters
     ///
     explicit Server(ServiceBase *service,
                     unsigned int port,
-                    const char *address);
+                    const char *address,
+                    const ServerOptions &options = ServerOptions());
+
+    //////////////////////////////////////
+    /// \brief Server listening on Unix domain socket
+    /// \param service object providing service to connections
+    /// \param socket_path path of the socket, existing file is replaced
+    /// \param permissions file permissions of the socket, used for access control
+    /// \param options server parameters
+    ///
+    explicit Server(ServiceBase *service,
+                    const char *socket_path,
+                    unsigned int permissions,
+                    const ServerOptions &options = ServerOptions());
+
     virtual ~Server();
 
     operator bool() const { return m_state; }
 
     ServiceBase* service() const { return m_service; }
+    size_t maxUploadSize() const { return m_max_upload_size; }
 
-    void suspend(MHD_Connection *conn); ///< Puts connection to sleep
+    /// \brief Puts connection to sleep, returns false if server is shutting down
+    ///
+    /// The callback is called after suspending, with the server lock held.
+    /// It is used to mark the connection as sleeping before the shutdown
+    /// can resume all sleeping connections
+    bool suspend(MHD_Connection *conn, const std::function<void()> &suspended = std::function<void()>());
     void resume(MHD_Connection *conn);  ///< Resumes connection
     void cleanup();                     ///< Call periodically to check on available connections
 
@@ -52,13 +85,18 @@ protected:
 #endif
 
 protected:
-    std::mutex m_mutex;
+    void startDaemon(const ServerOptions &options, MHD_OptionItem *address);
 
-    struct MHD_Daemon *m_daemon;
+protected:
+    // Locked for writing only on shutdown. Suspending connections takes
+    // the read lock, network threads do not block each other
+    QReadWriteLock m_lock;
+
+    struct MHD_Daemon *m_daemon = NULL;
     ServiceBase *m_service;
+    size_t m_max_upload_size;
     bool m_state = true;
-
-    std::set<MHD_Connection*> m_connections_sleeping;
+    std::string m_socket_path;
 };
 
 }
@@ -1,5 +1,15 @@
 #include "microhttpservicebase.h"
+#include "microhttpconnectionstore.h"
 
 MicroHTTP::ServiceBase::ServiceBase()
 {
 }
+
+unsigned int MicroHTTP::ServiceBase::servicePost(const char */*url*/, const QByteArray &/*body*/,
+                                                 MHD_Connection *, MHD_Response *,
+                                                 MicroHTTP::Connection::keytype connection_id)
+{
+    QByteArray data("POST is not supported");
+    MicroHTTP::ConnectionStore::setData(connection_id, data, false);
+    return MHD_HTTP_METHOD_NOT_ALLOWED;
+}
@@ -11,8 +11,25 @@ class ServiceBase
 {
 public:
     virtual unsigned int service(const char *url, MHD_Connection *, MHD_Response *, MicroHTTP::Connection::keytype connection_id) = 0;
+
+    /// \brief Serve POST request with the given body
+    ///
+    /// Response data has to be submitted to ConnectionStore as for GET
+    /// requests. By default, POST requests are not supported
+    virtual unsigned int servicePost(const char *url, const QByteArray &body,
+                                     MHD_Connection *, MHD_Response *, MicroHTTP::Connection::keytype connection_id);
     virtual void loguri(const char *) {}
 
+    /// \brief Called just before the request is served
+    ///
+    /// Returns id of the request used for tracing or 0 if the request is
+    /// not traced. The id is passed to requestCompleted
+    virtual uint64_t requestStarted(const char */*url*/) { return 0; }
+
+    /// \brief Called after the response to the traced request has been
+    /// sent or the request was terminated
+    virtual void requestCompleted(uint64_t /*id*/, bool /*ok*/) {}
+
 protected:
     ServiceBase();
     virtual ~ServiceBase() {}
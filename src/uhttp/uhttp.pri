@@ -5,12 +5,14 @@ SOURCES += \
     $$PWD/microhttpserver.cpp \
     $$PWD/microhttpconnectionstore.cpp \
     $$PWD/microhttpconnection.cpp \
+    $$PWD/microhttpcompressor.cpp \
     $$PWD/microhttpservicebase.cpp
 
 HEADERS += \
     $$PWD/microhttpserver.h \
     $$PWD/microhttpconnectionstore.h \
     $$PWD/microhttpconnection.h \
+    $$PWD/microhttpcompressor.h \
     $$PWD/microhttpservicebase.h
 
-LIBS += -lmicrohttpd
+LIBS += -lmicrohttpd -lz
@@ -0,0 +1,134 @@
+#include "watchdog.h"
+#include "infohub.h"
+#include "metrics.h"
+
+#include <QElapsedTimer>
+#include <QMutexLocker>
+
+namespace {
+
+struct Clock
+{
+    QElapsedTimer timer;
+    Clock() { timer.start(); }
+};
+
+Clock watchdog_clock;
+thread_local osmscout::BreakerRef current_breaker;
+
+}
+
+Watchdog::Watchdog()
+{
+}
+
+Watchdog::~Watchdog()
+{
+    stop();
+}
+
+qint64 Watchdog::now()
+{
+    return watchdog_clock.timer.elapsed();
+}
+
+osmscout::BreakerRef Watchdog::current()
+{
+    return current_breaker;
+}
+
+void Watchdog::setCurrent(const osmscout::BreakerRef &breaker)
+{
+    current_breaker = breaker;
+}
+
+bool Watchdog::expired()
+{
+    return current_breaker && current_breaker->IsAborted();
+}
+
+void Watchdog::start()
+{
+    QMutexLocker lk(&m_mutex);
+    if (m_running)
+        return;
+
+    m_running = true;
+    m_thread = std::thread(&Watchdog::run, this);
+}
+
+void Watchdog::stop()
+{
+    {
+        QMutexLocker lk(&m_mutex);
+        if (!m_running)
+            return;
+        m_running = false;
+        m_deadlines.clear();
+        m_watched.clear();
+        m_changed.wakeAll();
+    }
+    m_thread.join();
+}
+
+bool Watchdog::watch(Id id, qint64 deadline, const Expire &expire, const osmscout::BreakerRef &breaker)
+{
+    QMutexLocker lk(&m_mutex);
+    if (!m_running || m_watched.count(id) > 0)
+        return false;
+
+    bool earliest = (m_deadlines.empty() || deadline < m_deadlines.begin()->first);
+    m_watched[id] = m_deadlines.insert(std::make_pair(deadline, Entry{id, expire, breaker}));
+    if (earliest)
+        m_changed.wakeAll();
+    return true;
+}
+
+bool Watchdog::cancel(Id id)
+{
+    QMutexLocker lk(&m_mutex);
+    auto it = m_watched.find(id);
+    if (it == m_watched.end())
+        return false;
+
+    // watchdog thread waiting for the removed deadline moves to the next one on wakeup
+    m_deadlines.erase(it->second);
+    m_watched.erase(it);
+    return true;
+}
+
+void Watchdog::run()
+{
+    QMutexLocker lk(&m_mutex);
+    while (m_running)
+    {
+        if (m_deadlines.empty())
+        {
+            m_changed.wait(&m_mutex);
+            continue;
+        }
+
+        qint64 t = now();
+        qint64 next = m_deadlines.begin()->first;
+        if (next > t)
+        {
+            m_changed.wait(&m_mutex, (unsigned long)(next - t));
+            continue;
+        }
+
+        Entry e = m_deadlines.begin()->second;
+        m_deadlines.erase(m_deadlines.begin());
+        m_watched.erase(e.id);
+
+        // requests answered in time are not affected
+        lk.unlock();
+        if (e.expire())
+        {
+            if (e.breaker)
+                e.breaker->Break();
+            Metrics::increment(Metrics::RequestTimeouts);
+            InfoHub::logWarning("Request timed out");
+        }
+        lk.relock();
+    }
+}
@@ -0,0 +1,98 @@
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include <osmscout/util/Breaker.h>
+
+#include <QMutex>
+#include <QWaitCondition>
+
+#include <functional>
+#include <map>
+#include <thread>
+
+/// \brief Deadlines of the requests
+///
+/// Requests waiting for the response longer than the deadline of their
+/// endpoint are answered with the timeout error by a watchdog thread,
+/// releasing the connection slot. The workers serving the request are
+/// signalled through the breaker of the request. Backends supporting
+/// it, such as routing, abort the calculation, and the tasks that have
+/// not been started yet are skipped. Thread safe.
+///
+/// Breaker of the request is carried by the thread serving it and by
+/// the tasks started for it, as the trace of the request.
+class Watchdog
+{
+public:
+    Watchdog();
+    ~Watchdog();
+
+    /// \brief Start the watchdog thread
+    void start();
+
+    /// \brief Stop the watchdog thread, pending deadlines are dropped
+    void stop();
+
+    /// Called at the deadline, answers the request with the timeout
+    /// error. Returns false if the response was submitted already
+    typedef std::function<bool()> Expire;
+
+    /// Identifies the watched request, has to be unique
+    typedef quint64 Id;
+
+    /// \brief Expire the request at the given time, given as in now()
+    ///
+    /// If the request is expired, its breaker is triggered. Returns
+    /// false if the watchdog is not running or the request is watched
+    /// already
+    bool watch(Id id, qint64 deadline, const Expire &expire, const osmscout::BreakerRef &breaker);
+
+    /// \brief Stop watching the request, called when its response is submitted
+    ///
+    /// Returns true if the request was watched and has not been expired yet
+    bool cancel(Id id);
+
+    /// \brief Monotonic time in milliseconds, as used for deadlines
+    static qint64 now();
+
+    /// \brief Breaker of the request served by the current thread, nullptr if none
+    static osmscout::BreakerRef current();
+    static void setCurrent(const osmscout::BreakerRef &breaker);
+
+    /// \brief Whether the request served by the current thread has timed out
+    static bool expired();
+
+public:
+    /// \brief Makes the breaker current in this thread for the lifetime of the scope
+    class Scope
+    {
+    public:
+        Scope(const osmscout::BreakerRef &breaker): m_previous(current()) { setCurrent(breaker); }
+        ~Scope() { setCurrent(m_previous); }
+
+    protected:
+        osmscout::BreakerRef m_previous;
+    };
+
+protected:
+    void run();
+
+protected:
+    struct Entry
+    {
+        Id id;
+        Expire expire;
+        osmscout::BreakerRef breaker;
+    };
+
+    typedef std::multimap<qint64, Entry> Deadlines;
+
+    QMutex m_mutex;
+    QWaitCondition m_changed;
+    Deadlines m_deadlines;
+    std::map<Id, Deadlines::iterator> m_watched;
+    std::thread m_thread;
+    bool m_running = false;
+};
+
+#endif // WATCHDOG_H
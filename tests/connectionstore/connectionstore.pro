@@ -0,0 +1,6 @@
+TARGET = tst_connectionstore
+
+include(../tests.pri)
+include(../../src/uhttp/uhttp.pri)
+
+SOURCES += tst_connectionstore.cpp
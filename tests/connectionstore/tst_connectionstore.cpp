@@ -0,0 +1,180 @@
+#include "microhttpconnectionstore.h"
+
+#include <QtTest>
+
+using namespace MicroHTTP;
+
+// Connections are not suspended in these tests, the store does not
+// call the server and it can be left out
+class TestConnectionStore: public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void claimData();
+    void claimError();
+    void expire();
+    void expireAfterData();
+    void expireWrongSerial();
+    void serialReuse();
+    void stream();
+    void streamError();
+
+protected:
+    static Connection::State state(Connection::keytype key)
+    {
+        Server *server;
+        MHD_Connection *connection;
+        return ConnectionStore::state(key, server, connection);
+    }
+};
+
+void TestConnectionStore::claimData()
+{
+    Connection::keytype key = ConnectionStore::next(nullptr, nullptr);
+    QVERIFY(key != 0);
+    QCOMPARE(state(key), Connection::Wait);
+
+    QByteArray data("first");
+    ConnectionStore::setData(key, data, false);
+    QCOMPARE(state(key), Connection::Done);
+
+    // only the first response is accepted
+    QByteArray other("second");
+    ConnectionStore::setData(key, other, false);
+
+    QByteArray sent;
+    QVERIFY(ConnectionStore::dataToSend(key, sent));
+    QCOMPARE(sent, QByteArray("first"));
+
+    ConnectionStore::destroy(key);
+    QCOMPARE(state(key), Connection::NoInstance);
+}
+
+void TestConnectionStore::claimError()
+{
+    Connection::keytype key = ConnectionStore::next(nullptr, nullptr);
+    QByteArray data("failed");
+    ConnectionStore::setData(key, data, true);
+    QCOMPARE(state(key), Connection::Error);
+
+    // error message is sent as the response
+    QByteArray sent;
+    QVERIFY(ConnectionStore::dataToSend(key, sent));
+    QCOMPARE(sent, QByteArray("failed"));
+
+    ConnectionStore::destroy(key);
+}
+
+void TestConnectionStore::expire()
+{
+    Connection::keytype key = ConnectionStore::next(nullptr, nullptr);
+    uint64_t serial = ConnectionStore::serial(key);
+    QVERIFY(serial != 0);
+
+    QVERIFY(ConnectionStore::expire(key, serial));
+    QCOMPARE(state(key), Connection::Timeout);
+    QVERIFY(!ConnectionStore::expire(key, serial));
+
+    // response submitted after the timeout is ignored
+    QByteArray data("late");
+    ConnectionStore::setData(key, data, false);
+    QCOMPARE(state(key), Connection::Timeout);
+
+    QByteArray sent;
+    QVERIFY(!ConnectionStore::dataToSend(key, sent));
+
+    ConnectionStore::destroy(key);
+}
+
+void TestConnectionStore::expireAfterData()
+{
+    Connection::keytype key = ConnectionStore::next(nullptr, nullptr);
+    uint64_t serial = ConnectionStore::serial(key);
+
+    QByteArray data("ready");
+    ConnectionStore::setData(key, data, false);
+    QVERIFY(!ConnectionStore::expire(key, serial));
+    QCOMPARE(state(key), Connection::Done);
+
+    ConnectionStore::destroy(key);
+}
+
+void TestConnectionStore::expireWrongSerial()
+{
+    Connection::keytype key = ConnectionStore::next(nullptr, nullptr);
+    uint64_t serial = ConnectionStore::serial(key);
+
+    QVERIFY(!ConnectionStore::expire(key, serial + 1));
+    QCOMPARE(state(key), Connection::Wait);
+
+    ConnectionStore::destroy(key);
+}
+
+void TestConnectionStore::serialReuse()
+{
+    Connection::keytype first = ConnectionStore::next(nullptr, nullptr);
+    uint64_t first_serial = ConnectionStore::serial(first);
+    ConnectionStore::destroy(first);
+    QCOMPARE(ConnectionStore::serial(first), (uint64_t)0);
+
+    // free slots are reused in LIFO order, the slot is given to the next
+    // connection under a new key and serial
+    Connection::keytype second = ConnectionStore::next(nullptr, nullptr);
+    uint64_t second_serial = ConnectionStore::serial(second);
+    QVERIFY(second != first);
+    QVERIFY(second_serial != first_serial);
+
+    // timeout and response of the previous connection do not affect the new one
+    QVERIFY(!ConnectionStore::expire(first, first_serial));
+    QVERIFY(!ConnectionStore::expire(second, first_serial));
+    QByteArray data("stale");
+    ConnectionStore::setData(first, data, false);
+    QCOMPARE(state(first), Connection::NoInstance);
+    QCOMPARE(state(second), Connection::Wait);
+
+    QVERIFY(ConnectionStore::expire(second, second_serial));
+    ConnectionStore::destroy(second);
+}
+
+void TestConnectionStore::stream()
+{
+    Connection::keytype key = ConnectionStore::next(nullptr, nullptr);
+    QVERIFY(ConnectionStore::append(key, "abc"));
+    QVERIFY(ConnectionStore::append(key, "def"));
+    QCOMPARE(state(key), Connection::Streaming);
+
+    // streaming connection is not timed out
+    QVERIFY(!ConnectionStore::expire(key, ConnectionStore::serial(key)));
+
+    char buf[16];
+    QCOMPARE(ConnectionStore::readStream(key, buf, 4), (ssize_t)4);
+    QCOMPARE(QByteArray(buf, 4), QByteArray("abcd"));
+    QCOMPARE(ConnectionStore::readStream(key, buf, sizeof(buf)), (ssize_t)2);
+    QCOMPARE(QByteArray(buf, 2), QByteArray("ef"));
+    QCOMPARE(ConnectionStore::readStream(key, buf, sizeof(buf)), (ssize_t)0);
+
+    ConnectionStore::finish(key, false);
+    QCOMPARE(ConnectionStore::readStream(key, buf, sizeof(buf)), (ssize_t)MHD_CONTENT_READER_END_OF_STREAM);
+
+    ConnectionStore::destroy(key);
+    QVERIFY(!ConnectionStore::append(key, "late"));
+}
+
+void TestConnectionStore::streamError()
+{
+    Connection::keytype key = ConnectionStore::next(nullptr, nullptr);
+    QVERIFY(ConnectionStore::append(key, "abc"));
+    ConnectionStore::finish(key, true);
+
+    // data appended before the error is sent before aborting
+    char buf[16];
+    QCOMPARE(ConnectionStore::readStream(key, buf, sizeof(buf)), (ssize_t)3);
+    QCOMPARE(ConnectionStore::readStream(key, buf, sizeof(buf)), (ssize_t)MHD_CONTENT_READER_END_WITH_ERROR);
+
+    ConnectionStore::destroy(key);
+}
+
+QTEST_APPLESS_MAIN(TestConnectionStore)
+
+#include "tst_connectionstore.moc"
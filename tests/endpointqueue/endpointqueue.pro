@@ -0,0 +1,10 @@
+TARGET = tst_endpointqueue
+
+include(../tests.pri)
+
+SOURCES += \
+    tst_endpointqueue.cpp \
+    $$PWD/../../src/endpointqueue.cpp
+
+HEADERS += \
+    $$PWD/../../src/endpointqueue.h
@@ -0,0 +1,145 @@
+#include "endpointqueue.h"
+
+#include <QtTest>
+#include <QSemaphore>
+
+#include <atomic>
+
+// Task blocking until released, counts started and deleted tasks
+class BlockingTask: public QRunnable
+{
+public:
+    BlockingTask(QSemaphore &release, std::atomic<int> &started, std::atomic<int> &deleted):
+        QRunnable(),
+        m_release(release),
+        m_started(started),
+        m_deleted(deleted)
+    {
+    }
+
+    virtual ~BlockingTask()
+    {
+        ++m_deleted;
+    }
+
+    virtual void run()
+    {
+        ++m_started;
+        m_release.acquire();
+    }
+
+protected:
+    QSemaphore &m_release;
+    std::atomic<int> &m_started;
+    std::atomic<int> &m_deleted;
+};
+
+class TestEndpointQueue: public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void limits();
+    void clear();
+    void poolSize();
+};
+
+void TestEndpointQueue::limits()
+{
+    QThreadPool pool;
+    pool.setMaxThreadCount(4);
+
+    QSemaphore release;
+    std::atomic<int> started(0), deleted(0);
+
+    EndpointQueue queue("test");
+    queue.setup(&pool, 2, 1);
+
+    QVERIFY(queue.start(new BlockingTask(release, started, deleted)));
+    QVERIFY(queue.start(new BlockingTask(release, started, deleted)));
+    QCOMPARE(queue.running(), 2);
+    QTRY_COMPARE(started.load(), 2);
+
+    // pool has free threads, the task waits for the running ones
+    QVERIFY(queue.start(new BlockingTask(release, started, deleted)));
+    QCOMPARE(queue.queued(), 1);
+
+    // rejected task stays with the caller
+    BlockingTask *rejected = new BlockingTask(release, started, deleted);
+    QVERIFY(!queue.start(rejected));
+    QCOMPARE(deleted.load(), 0);
+    delete rejected;
+
+    // finished task starts the waiting one
+    release.release();
+    QTRY_COMPARE(started.load(), 3);
+    QCOMPARE(queue.queued(), 0);
+    QCOMPARE(queue.running(), 2);
+
+    // queue accepts tasks again
+    QVERIFY(queue.start(new BlockingTask(release, started, deleted)));
+
+    release.release(3);
+    pool.waitForDone();
+    QCOMPARE(started.load(), 4);
+    QCOMPARE(deleted.load(), 5);
+    QCOMPARE(queue.running(), 0);
+    QCOMPARE(queue.queued(), 0);
+}
+
+void TestEndpointQueue::clear()
+{
+    QThreadPool pool;
+    pool.setMaxThreadCount(2);
+
+    QSemaphore release;
+    std::atomic<int> started(0), deleted(0);
+
+    EndpointQueue queue("test");
+    queue.setup(&pool, 1, 2);
+
+    QVERIFY(queue.start(new BlockingTask(release, started, deleted)));
+    QVERIFY(queue.start(new BlockingTask(release, started, deleted)));
+    QVERIFY(queue.start(new BlockingTask(release, started, deleted)));
+    QCOMPARE(queue.queued(), 2);
+
+    // waiting tasks are dropped, the running one is finished
+    queue.clear();
+    QCOMPARE(queue.queued(), 0);
+    QCOMPARE(deleted.load(), 2);
+
+    release.release();
+    pool.waitForDone();
+    QCOMPARE(started.load(), 1);
+    QCOMPARE(deleted.load(), 3);
+    QCOMPARE(queue.running(), 0);
+}
+
+void TestEndpointQueue::poolSize()
+{
+    QThreadPool pool;
+    pool.setMaxThreadCount(3);
+
+    QSemaphore release;
+    std::atomic<int> started(0), deleted(0);
+
+    // without the limit, the queue gives the pool as many tasks as it has threads
+    EndpointQueue queue("test");
+    queue.setup(&pool, 0, 0);
+
+    for (int i=0; i < 3; ++i)
+        QVERIFY(queue.start(new BlockingTask(release, started, deleted)));
+
+    BlockingTask *rejected = new BlockingTask(release, started, deleted);
+    QVERIFY(!queue.start(rejected));
+    delete rejected;
+
+    release.release(3);
+    pool.waitForDone();
+    QCOMPARE(started.load(), 3);
+    QCOMPARE(queue.running(), 0);
+}
+
+QTEST_GUILESS_MAIN(TestEndpointQueue)
+
+#include "tst_endpointqueue.moc"
@@ -0,0 +1,30 @@
+#include "infohub.h"
+
+// Replaces InfoHub in the unit tests. Warnings and errors are printed,
+// the other calls are ignored
+
+void InfoHub::setError(bool)
+{
+}
+
+void InfoHub::logInfo(const QString &, bool)
+{
+}
+
+void InfoHub::logWarning(const QString &txt)
+{
+    qWarning("%s", txt.toUtf8().constData());
+}
+
+void InfoHub::logError(const QString &txt)
+{
+    qWarning("%s", txt.toUtf8().constData());
+}
+
+void InfoHub::addJobToQueue()
+{
+}
+
+void InfoHub::removeJobFromQueue()
+{
+}
@@ -0,0 +1,12 @@
+# Settings shared by the unit tests
+
+QT = core testlib
+
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+
+INCLUDEPATH += $$PWD/../src
+DEPENDPATH += $$PWD/../src
+
+# logging of the tested components is not needed
+SOURCES += $$PWD/infohubstub.cpp
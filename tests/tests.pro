@@ -0,0 +1,13 @@
+# Unit tests of the server components
+#
+# Build in a separate directory and run with
+#
+#   qmake ../tests/tests.pro
+#   make check
+
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    connectionstore \
+    watchdog \
+    endpointqueue
@@ -0,0 +1,164 @@
+#include "watchdog.h"
+
+#include <QtTest>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+class TestWatchdog: public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void expire();
+    void expireAfterResponse();
+    void cancel();
+    void cancelAfterExpire();
+    void watchTwice();
+    void notRunning();
+    void order();
+    void scope();
+};
+
+// expire callback recording the call and answering as given
+static Watchdog::Expire expireCall(std::shared_ptr<std::atomic<int>> calls, bool answer)
+{
+    return [calls, answer]() {
+        ++(*calls);
+        return answer;
+    };
+}
+
+void TestWatchdog::expire()
+{
+    Watchdog watchdog;
+    watchdog.start();
+
+    auto calls = std::make_shared<std::atomic<int>>(0);
+    osmscout::BreakerRef breaker = std::make_shared<osmscout::ThreadedBreaker>();
+    QVERIFY(watchdog.watch(1, Watchdog::now() + 10, expireCall(calls, true), breaker));
+
+    QTRY_COMPARE(calls->load(), 1);
+    QTRY_VERIFY(breaker->IsAborted());
+}
+
+void TestWatchdog::expireAfterResponse()
+{
+    Watchdog watchdog;
+    watchdog.start();
+
+    // response was submitted already, the workers are not aborted
+    auto calls = std::make_shared<std::atomic<int>>(0);
+    osmscout::BreakerRef breaker = std::make_shared<osmscout::ThreadedBreaker>();
+    QVERIFY(watchdog.watch(1, Watchdog::now() + 10, expireCall(calls, false), breaker));
+
+    QTRY_COMPARE(calls->load(), 1);
+    QTest::qWait(50);
+    QVERIFY(!breaker->IsAborted());
+}
+
+void TestWatchdog::cancel()
+{
+    Watchdog watchdog;
+    watchdog.start();
+
+    auto calls = std::make_shared<std::atomic<int>>(0);
+    osmscout::BreakerRef breaker = std::make_shared<osmscout::ThreadedBreaker>();
+    QVERIFY(watchdog.watch(1, Watchdog::now() + 100, expireCall(calls, true), breaker));
+    QVERIFY(watchdog.cancel(1));
+    QVERIFY(!watchdog.cancel(1));
+
+    QTest::qWait(200);
+    QCOMPARE(calls->load(), 0);
+    QVERIFY(!breaker->IsAborted());
+}
+
+void TestWatchdog::cancelAfterExpire()
+{
+    Watchdog watchdog;
+    watchdog.start();
+
+    // the response submitted after the deadline does not own the request
+    auto calls = std::make_shared<std::atomic<int>>(0);
+    QVERIFY(watchdog.watch(1, Watchdog::now(), expireCall(calls, true), osmscout::BreakerRef()));
+    QTRY_COMPARE(calls->load(), 1);
+    QVERIFY(!watchdog.cancel(1));
+}
+
+void TestWatchdog::watchTwice()
+{
+    Watchdog watchdog;
+    watchdog.start();
+
+    auto calls = std::make_shared<std::atomic<int>>(0);
+    QVERIFY(watchdog.watch(1, Watchdog::now() + 10000, expireCall(calls, true), osmscout::BreakerRef()));
+    QVERIFY(!watchdog.watch(1, Watchdog::now() + 10000, expireCall(calls, true), osmscout::BreakerRef()));
+
+    // the id can be watched again after cancelling
+    QVERIFY(watchdog.cancel(1));
+    QVERIFY(watchdog.watch(1, Watchdog::now() + 10000, expireCall(calls, true), osmscout::BreakerRef()));
+}
+
+void TestWatchdog::notRunning()
+{
+    Watchdog watchdog;
+    auto calls = std::make_shared<std::atomic<int>>(0);
+    QVERIFY(!watchdog.watch(1, Watchdog::now(), expireCall(calls, true), osmscout::BreakerRef()));
+
+    // pending deadlines are dropped on stop
+    watchdog.start();
+    QVERIFY(watchdog.watch(2, Watchdog::now() + 10000, expireCall(calls, true), osmscout::BreakerRef()));
+    watchdog.stop();
+    QVERIFY(!watchdog.cancel(2));
+    QVERIFY(!watchdog.watch(3, Watchdog::now(), expireCall(calls, true), osmscout::BreakerRef()));
+    QCOMPARE(calls->load(), 0);
+}
+
+void TestWatchdog::order()
+{
+    QMutex mutex;
+    std::vector<int> expired;
+    auto record = [&mutex, &expired](int id) {
+        return [&mutex, &expired, id]() {
+            QMutexLocker lk(&mutex);
+            expired.push_back(id);
+            return true;
+        };
+    };
+    auto count = [&mutex, &expired]() {
+        QMutexLocker lk(&mutex);
+        return expired.size();
+    };
+
+    Watchdog watchdog;
+    watchdog.start();
+
+    // later deadline is inserted first, the watchdog has to wake up earlier
+    qint64 now = Watchdog::now();
+    QVERIFY(watchdog.watch(1, now + 200, record(1), osmscout::BreakerRef()));
+    QVERIFY(watchdog.watch(2, now + 50, record(2), osmscout::BreakerRef()));
+
+    QTRY_COMPARE(count(), (size_t)2);
+    QCOMPARE(expired[0], 2);
+    QCOMPARE(expired[1], 1);
+}
+
+void TestWatchdog::scope()
+{
+    osmscout::BreakerRef breaker = std::make_shared<osmscout::ThreadedBreaker>();
+    QVERIFY(!Watchdog::current());
+    {
+        Watchdog::Scope scope(breaker);
+        QVERIFY(Watchdog::current() == breaker);
+        QVERIFY(!Watchdog::expired());
+        breaker->Break();
+        QVERIFY(Watchdog::expired());
+    }
+    QVERIFY(!Watchdog::current());
+    QVERIFY(!Watchdog::expired());
+}
+
+QTEST_GUILESS_MAIN(TestWatchdog)
+
+#include "tst_watchdog.moc"
@@ -0,0 +1,14 @@
+TARGET = tst_watchdog
+
+include(../tests.pri)
+
+SOURCES += \
+    tst_watchdog.cpp \
+    $$PWD/../../src/watchdog.cpp \
+    $$PWD/../../src/metrics.cpp
+
+HEADERS += \
+    $$PWD/../../src/watchdog.h \
+    $$PWD/../../src/metrics.h
+
+LIBS += -losmscout